@@ -46,12 +46,31 @@ typedef void (*ser_send_handler_cb)(char *data, size_t len);
  */
 typedef uint8_t (*ser_available_handler_cb)(void);
 
+/**
+ * @brief Optional bulk read. Copy up to @p len waiting bytes into @p buf without blocking and return the count
+ */
+typedef uint16_t (*ser_read_handler_cb)(uint8_t *buf, uint16_t len);
+
+/**
+ * @brief Change the host serial port to @p baud. Return #DGUS_OK once the port runs at the new rate
+ */
+typedef uint8_t (*ser_baud_handler_cb)(uint32_t baud);
+
 
 /**
  * @brief Opaque reference to a packet 
  */
 typedef struct dgus_packet dgus_packet;
 
+/**
+ * @brief A frame found by dgus_frame_scan(). @p data points into the scanned buffer
+ */
+typedef struct dgus_frame {
+  uint8_t cmd;                  /**< command byte such as DGUS_CMD_VAR_R */
+  uint8_t len;                  /**< payload bytes after the command */
+  const uint8_t *data;          /**< payload */
+} dgus_frame;
+
 /**
  * @brief Initialise the DGUS LCD interface
  * 
@@ -67,12 +86,97 @@ void dgus_init(ser_available_handler_cb avail, ser_recv_handler_cb recv, ser_sen
 
 /**
  * @brief Receive and process data from the serial port.
- * Call this in your main loop
+ * Call this in your main loop. Queued packets are handed to the packet handler before it returns.
  * 
  * @return int returns < 1 error, 0 for no data
  */
 int dgus_recv_data();
 
+/**
+ * @brief Hand queued packets to the packet handler
+ * Packets parsed while the library waits for an ACK or a read reply are queued rather than
+ * handled in place, so a handler may freely send. dgus_recv_data() calls this for you.
+ * A packet identical to the newest one still waiting, such as a held key repeating, is only handled once.
+ * Replies to dgus_get_var() and the other blocking reads go to their caller and are never queued.
+ * 
+ * @return uint8_t number of packets handled. Always 0 when EVENT_QUEUE_ENTRIES is 0
+ */
+uint8_t dgus_process_events();
+
+/**
+ * @brief Packets lost because the queue was full
+ * 
+ * @return uint16_t count since dgus_init()
+ */
+uint16_t dgus_events_dropped();
+
+/**
+ * @brief Let the library change the host serial port rate, see dgus_set_baud()
+ * 
+ * @param handler function that reconfigures the host port
+ * @param baud rate the host port runs at now
+ */
+void dgus_set_baud_handler(ser_baud_handler_cb handler, uint32_t baud);
+
+/**
+ * @brief Rate the host port runs at, as last given to the library
+ * 
+ * @return uint32_t baud, 0 if never set
+ */
+uint32_t dgus_get_host_baud();
+
+/**
+ * @brief Move the host port alone to @p baud and discard anything received at the old rate
+ * 
+ * @param baud new rate
+ * @return #DGUS_RETURN #DGUS_ERROR without a baud handler or if it failed
+ */
+DGUS_RETURN dgus_set_host_baud(uint32_t baud);
+
+/**
+ * @brief Drop buffered input and any partly received packet
+ */
+void dgus_recv_reset();
+
+/**
+ * @brief Read waiting bytes in blocks rather than one call per byte
+ * 
+ * @param read bulk read function, NULL to go back to the single byte recv handler
+ */
+void dgus_set_read_handler(ser_read_handler_cb read);
+
+/**
+ * @brief Bytes thrown away while finding the next frame, e.g. after line noise
+ * 
+ * @return uint32_t count since start up
+ */
+uint32_t dgus_recv_discarded();
+
+/**
+ * @brief Find the next well formed frame in a byte stream
+ * Scans for the header, then checks the length, command and the counts inside the payload,
+ * stepping one byte past any header that fails. This is the parser dgus_recv_data() uses.
+ * 
+ * @param buf bytes received
+ * @param len number of bytes in @p buf
+ * @param used set to the bytes that can be dropped from the front of @p buf: noise, plus the
+ * frame when one was found. Bytes after it may be the start of a frame still arriving
+ * @param frame filled when a frame was found
+ * @return uint8_t 1 if @p frame holds a frame
+ */
+uint8_t dgus_frame_scan(const uint8_t *buf, size_t len, size_t *used, dgus_frame *frame);
+
+/**
+ * @brief dgus_frame_scan() for frames going the other way, host to panel, e.g. from a capture
+ * 
+ * @param buf bytes sent
+ * @param len number of bytes in @p buf
+ * @param used as for dgus_frame_scan()
+ * @param frame filled when a frame was found
+ * @return uint8_t 1 if @p frame holds a frame
+ */
+uint8_t dgus_frame_scan_sent(const uint8_t *buf, size_t len, size_t *used, dgus_frame *frame);
+
 /**
  * @brief Append 1 byte len bytes to the send buffer in 8 bit format
  * 
@@ -182,11 +286,37 @@ DGUS_RETURN dgus_set_var8(uint16_t addr, uint8_t *data, uint8_t len);
 
 /**
  * @brief Manually initialise the packet sending buffer
+ * This is one shared packet. Prefer dgus_packet_acquire() when a handler may send while it is being built.
  * 
  * @return dgus_packet* Opaque pointer to the packet buffer
  */
 dgus_packet *dgus_packet_init();
 
+/**
+ * @brief Take a packet buffer from the pool of PACKET_POOL_SIZE
+ * Only the header and length are reset. A frame can be built in one while another is in flight,
+ * and a handler sending from inside a send never clobbers the caller's buffer.
+ * 
+ * @return dgus_packet* an empty packet, NULL if all are in use
+ */
+dgus_packet *dgus_packet_acquire();
+
+/**
+ * @brief Give a packet back to the pool
+ * 
+ * @param p packet from dgus_packet_acquire(). Others are ignored
+ */
+void dgus_packet_release(dgus_packet *p);
+
+/**
+ * @brief send_data() and then release the packet
+ * 
+ * @param cmd command type such as DGUS_CMD_VAR_W
+ * @param p packet from dgus_packet_acquire()
+ * @return Response such as #DGUS_TIMEOUT
+ */
+DGUS_RETURN dgus_packet_send(enum command cmd, dgus_packet *p);
+
 
 
 /* internal utility */
@@ -198,6 +328,38 @@ dgus_packet *dgus_packet_init();
  */
 void dgus_packet_set_len(dgus_packet *p, uint16_t len);
 
+/**
+ * @brief Send a frame straight to the display, bypassing lazy page updates and the scheduler
+ * Does not touch the shared packet from dgus_packet_init()
+ * 
+ * @param cmd command type such as DGUS_CMD_VAR_W
+ * @param data payload, VP address first
+ * @param len payload length in bytes
+ * @return Response such as #DGUS_TIMEOUT
+ */
+DGUS_RETURN dgus_send_frame(enum command cmd, const uint8_t *data, uint8_t len);
+
+/**
+ * @brief Send a frame straight to the display without waiting for its ACK
+ * For writes whose ACK cannot be read, such as one that changes the link rate.
+ * Any ACK that does arrive is handled as a stray packet
+ * 
+ * @param cmd command type such as DGUS_CMD_VAR_W
+ * @param data payload, VP address first
+ * @param len payload length in bytes
+ * @return #DGUS_ERROR if the payload does not fit, otherwise #DGUS_OK
+ */
+DGUS_RETURN dgus_send_frame_nowait(enum command cmd, const uint8_t *data, uint8_t len);
+
+/**
+ * @brief Reserve @p len bytes at the end of the packet for the caller to fill in place
+ * 
+ * @param p 
+ * @param len 
+ * @return uint8_t* start of the reserved bytes, NULL if they do not fit the send buffer
+ */
+uint8_t *dgus_packet_reserve(dgus_packet *p, uint8_t len);
+
 /**
  * @brief Get a pointer the current data recv buffer
  * 
@@ -206,7 +368,9 @@ void dgus_packet_set_len(dgus_packet *p, uint16_t len);
 uint8_t *dgus_packet_get_recv_buffer();
 
 /**
- * @brief Wait for the OK to return or data to arrive
+ * @brief Wait for data to arrive. After a VAR read, only the reply with the same VP and
+ * word count ends the wait. It is not passed to the packet handler; uploads arriving first are
+ * handled as usual
  * 
  * @return uint8_t 
  */
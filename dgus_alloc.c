@@ -0,0 +1,77 @@
+/**
+ * @file dgus_alloc.c
+ * @author Barry Carter
+ * @date 01 Jan 2021
+ * @brief DGUS II LCD Object allocation, heap or static pool
+ */
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdalign.h>
+#include "dgus.h"
+#include "dgus_alloc.h"
+
+#if DGUS_STATIC_ALLOC
+
+#define POOL_ALIGN alignof(max_align_t)
+#define POOL_HEADER ((sizeof(size_t) + POOL_ALIGN - 1) & ~(POOL_ALIGN - 1))   /**< holds the previous top */
+#define POOL_NONE SIZE_MAX
+
+static alignas(max_align_t) uint8_t _pool_mem[DGUS_POOL_BYTES];
+static uint8_t *_pool = _pool_mem;
+static size_t _pool_len = DGUS_POOL_BYTES;
+static size_t _used;
+static size_t _last = POOL_NONE;       /**< offset of the most recent allocation still held */
+
+void dgus_pool_init(void *mem, size_t len) {
+  _pool = mem;
+  _pool_len = len;
+  dgus_pool_reset();
+}
+
+void dgus_pool_reset() {
+  _used = 0;
+  _last = POOL_NONE;
+}
+
+size_t dgus_pool_available() {
+  return _pool_len - _used;
+}
+
+void *dgus_calloc(size_t n, size_t size) {
+  size_t start = ((_used + POOL_ALIGN - 1) & ~(POOL_ALIGN - 1)) + POOL_HEADER;
+
+  if (start > _pool_len)
+    return NULL;
+  if (size && n > (_pool_len - start) / size)
+    return NULL;
+
+  // each block remembers the one below, so frees in reverse order unwind the whole pool
+  memcpy(&_pool[start - POOL_HEADER], &_last, sizeof(size_t));
+  _last = start;
+  _used = start + n * size;
+  memset(&_pool[start], 0, n * size);
+  return &_pool[start];
+}
+
+void dgus_free(void *p) {
+  // a bump pool can only give back its top
+  if (p && _last != POOL_NONE && (uint8_t *)p == &_pool[_last]) {
+    _used = _last - POOL_HEADER;
+    memcpy(&_last, &_pool[_used], sizeof(size_t));
+  }
+}
+
+#else
+
+void *dgus_calloc(size_t n, size_t size) {
+  return calloc(n, size);
+}
+
+void dgus_free(void *p) {
+  free(p);
+}
+
+#endif
@@ -0,0 +1,54 @@
+#pragma once
+/**
+ * @file dgus_alloc.h
+ * @author Barry Carter
+ * @date 01 Jan 2021
+ * @brief DGUS II LCD Object allocation, heap or static pool
+ */
+#include <stddef.h>
+#include <stdint.h>
+#include "dgus_reg.h"
+#include "dgus.h"
+
+/**
+ * @brief Allocate zeroed memory for a library object (curves, ingestion queues, display lists, canvases)
+ * With DGUS_STATIC_ALLOC set this never touches the heap, objects are carved from the pool.
+ *
+ * @param n number of elements
+ * @param size element size
+ * @return void* the memory, NULL if it is not available
+ */
+void *dgus_calloc(size_t n, size_t size);
+
+/**
+ * @brief Release memory from dgus_calloc()
+ * The pool is a stack: a free only gives memory back when @p p is the most recent allocation
+ * still held, so free in the reverse order of allocation. Anything freed out of order stays
+ * used until dgus_pool_reset().
+ *
+ * @param p memory, NULL is ignored
+ */
+void dgus_free(void *p);
+
+#if DGUS_STATIC_ALLOC
+/**
+ * @brief Carve objects from caller memory instead of the built in DGUS_POOL_BYTES pool
+ * Everything allocated so far is forgotten.
+ *
+ * @param mem memory, suitably aligned for any type
+ * @param len bytes
+ */
+void dgus_pool_init(void *mem, size_t len);
+
+/**
+ * @brief Forget every allocation, e.g. between screens built from scratch
+ */
+void dgus_pool_reset();
+
+/**
+ * @brief Pool bytes still free, to size DGUS_POOL_BYTES
+ *
+ * @return size_t bytes
+ */
+size_t dgus_pool_available();
+#endif
@@ -0,0 +1,220 @@
+/**
+ * @file dgus_audio.c
+ * @author Barry Carter
+ * @date 01 Jan 2021
+ * @brief DGUS II LCD Audio streaming through MusicStreaming
+ */
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "dgus.h"
+#include "dgus_audio.h"
+#include "dgus_tx.h"
+
+#define AUDIO_FRAME_BYTES ((SEND_BUFFER_SIZE - 2) & ~1)  /**< PCM bytes per write frame */
+#define AUDIO_FRAME_WIRE  (AUDIO_FRAME_BYTES + 6)        /**< the same frame on the wire */
+#define AUDIO_BUF_BYTES   (AUDIO_BUF_WORDS * 2)
+#define AUDIO_DEFAULT_BAUD 115200                        /**< the panel's power on rate */
+
+static const uint16_t _bufs[2] = { AUDIO_BUF_A, AUDIO_BUF_B };
+
+static dgus_audio_source_cb _source;
+static void *_ctx;
+static uint32_t _byte_rate;
+
+/* Host ring. The size need not be a power of two, so the tail is kept below it with a count */
+static uint8_t _ring[AUDIO_RING_BYTES];
+static uint32_t _ring_size;
+static uint32_t _tail;
+static uint32_t _used;
+
+static uint8_t _stage;                  /**< panel buffer being filled */
+static uint16_t _fill;                  /**< bytes staged in it */
+static uint8_t _playing;                /**< a buffer was started and has not been seen to finish */
+static uint32_t _play_end;              /**< when it should finish */
+static uint8_t _eof;
+static uint8_t _starved;                /**< underrun already counted for this gap */
+static dgus_audio_stats _stats;
+
+DGUS_RETURN dgus_audio_start(uint32_t byte_rate, dgus_audio_source_cb source, void *ctx) {
+  uint32_t baud = dgus_get_host_baud();
+  if (!baud)
+    baud = dgus_tx_get_baud();
+  if (!baud)
+    baud = AUDIO_DEFAULT_BAUD;
+
+  // PCM the link carries a second, after frame overhead
+  uint32_t link = baud / 10 * AUDIO_FRAME_BYTES / AUDIO_FRAME_WIRE;
+  if (byte_rate == 0 || byte_rate > link)
+    return DGUS_AUDIO_RATE;
+
+  uint32_t size = link * AUDIO_RING_MS / 1000;
+  size -= size % AUDIO_FRAME_BYTES;
+  if (size < AUDIO_FRAME_BYTES)
+    size = AUDIO_FRAME_BYTES;
+  if (size > AUDIO_RING_BYTES)
+    size = AUDIO_RING_BYTES;
+
+  _source = source;
+  _ctx = ctx;
+  _byte_rate = byte_rate;
+  _ring_size = size;
+  _tail = _used = 0;
+  _fill = 0;
+  _eof = 0;
+  _starved = 0;
+  memset(&_stats, 0, sizeof(_stats));
+  _stats.ring_size = size;
+
+  return DGUS_OK;
+}
+
+DGUS_RETURN dgus_audio_stop() {
+  uint8_t d[4] = { MusicStreaming >> 8, MusicStreaming & 0xFF, AUDIO_CMD_STOP, 0x00 };
+
+  _source = NULL;
+  _playing = 0;
+  return dgus_send_frame(DGUS_CMD_VAR_W, d, sizeof(d));
+}
+
+uint8_t dgus_audio_active() {
+  return _source != NULL;
+}
+
+void dgus_audio_get_stats(dgus_audio_stats *stats) {
+  *stats = _stats;
+}
+
+static void _pull() {
+  while (!_eof && _used < _ring_size) {
+    uint32_t at = _tail + _used;
+    if (at >= _ring_size)
+      at -= _ring_size;
+    uint32_t room = _ring_size - _used;
+    uint32_t n = _ring_size - at < room ? _ring_size - at : room;
+
+    uint32_t got = _source(&_ring[at], n, _ctx);
+    if (got == DGUS_AUDIO_EOF) {
+      _eof = 1;
+      break;
+    }
+    if (got > n)
+      got = n;
+    _used += got;
+    if (got < n)
+      break;
+  }
+}
+
+/* Ring to the panel buffer being filled, a full frame at a time until the stream ends */
+static DGUS_RETURN _push() {
+  uint8_t frame[2 + AUDIO_FRAME_BYTES];
+
+  while (_fill < AUDIO_BUF_BYTES) {
+    if (_used == 0 || (_used < AUDIO_FRAME_BYTES && !_eof))
+      break;
+
+    uint16_t n = AUDIO_FRAME_BYTES;
+    if (n > _used)
+      n = _used;
+    if (n > AUDIO_BUF_BYTES - _fill)
+      n = AUDIO_BUF_BYTES - _fill;
+
+    for (uint16_t i = 0, at = _tail; i < n; i++) {
+      frame[2 + i] = _ring[at];
+      if (++at == _ring_size)
+        at = 0;
+    }
+    uint16_t len = n;
+    if (len & 1)
+      frame[2 + len++] = 0;
+
+    uint16_t vp = _bufs[_stage] + _fill / 2;
+    frame[0] = vp >> 8;
+    frame[1] = vp & 0xFF;
+    if (dgus_send_frame(DGUS_CMD_VAR_W, frame, 2 + len) != DGUS_OK)
+      return DGUS_TIMEOUT;
+
+    _tail += n;
+    if (_tail >= _ring_size)
+      _tail -= _ring_size;
+    _used -= n;
+    _fill += len;
+    _stats.bytes += n;
+  }
+  return DGUS_OK;
+}
+
+/* D7 start, D6 0, D5:D4 VP of the PCM, D3:D2 length in words */
+static DGUS_RETURN _play(uint16_t vp, uint16_t words) {
+  uint8_t d[8] = {
+    MusicStreaming >> 8, MusicStreaming & 0xFF,
+    AUDIO_CMD_START, 0x00, vp >> 8, vp & 0xFF, words >> 8, words & 0xFF
+  };
+  return dgus_send_frame(DGUS_CMD_VAR_W, d, sizeof(d));
+}
+
+/* Start the staged buffer if it is ready, @p started says whether it was */
+static DGUS_RETURN _start_next(uint32_t now, uint8_t *started) {
+  DGUS_RETURN r;
+
+  *started = 0;
+  if (_playing || !(_fill == AUDIO_BUF_BYTES || (_eof && _fill)))
+    return DGUS_OK;
+
+  if ((r = _play(_bufs[_stage], _fill / 2)) != DGUS_OK)
+    return r;
+  _playing = 1;
+  _play_end = now + (uint32_t)((uint64_t)_fill * 1000 / _byte_rate);
+  _stage ^= 1;
+  _fill = 0;
+  _starved = 0;
+  _stats.buffers++;
+  *started = 1;
+  return DGUS_OK;
+}
+
+DGUS_RETURN dgus_audio_service() {
+  DGUS_RETURN r;
+  uint8_t started;
+
+  if (!_source)
+    return DGUS_OK;
+
+  uint32_t now = dgus_tx_millis();
+
+  // poll from just before the buffer should run out, so the next one follows without a gap
+  if (_playing && (int32_t)(now + AUDIO_POLL_LEAD_MS - _play_end) >= 0) {
+    uint16_t w = 0;
+    if ((r = dgus_get_var(MusicStreaming, &w, 1)) != DGUS_OK)
+      return r;
+    if ((w >> 8) == 0)
+      _playing = 0;
+  }
+
+  // the other buffer was staged while this one played, start it before sending more
+  if ((r = _start_next(now, &started)) != DGUS_OK)
+    return r;
+
+  _pull();
+  if ((r = _push()) != DGUS_OK)
+    return r;
+
+  if (!started && (r = _start_next(dgus_tx_millis(), &started)) != DGUS_OK)
+    return r;
+
+  if (_playing || started)
+    return DGUS_OK;
+
+  if (_eof && _used == 0) {
+    _source = NULL;
+  }
+  else if (_stats.buffers && !_starved) {
+    _starved = 1;
+    _stats.underruns++;
+  }
+
+  return DGUS_OK;
+}
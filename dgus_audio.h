@@ -0,0 +1,78 @@
+#pragma once
+/**
+ * @file dgus_audio.h
+ * @author Barry Carter
+ * @date 01 Jan 2021
+ * @brief DGUS II LCD Audio streaming through MusicStreaming
+ */
+#include <stddef.h>
+#include <stdint.h>
+#include "dgus_reg.h"
+#include "dgus.h"
+
+#define AUDIO_CMD_START 0x5A           /**< MusicStreaming D7 to play a buffer, cleared by the panel when done */
+#define AUDIO_CMD_STOP  0x00           /**< MusicStreaming D7 to stop the buffer that is playing */
+#define DGUS_AUDIO_EOF  0xFFFFFFFF     /**< returned by a #dgus_audio_source_cb at the end of the stream */
+
+/**
+ * @brief Produce the next PCM bytes, in the format the panel was set up to play
+ *
+ * @param buf buffer to fill
+ * @param len bytes wanted
+ * @param ctx context given to dgus_audio_start()
+ * @return uint32_t bytes produced, 0 if none are ready yet, #DGUS_AUDIO_EOF when the stream is over
+ */
+typedef uint32_t (*dgus_audio_source_cb)(uint8_t *buf, uint32_t len, void *ctx);
+
+/**
+ * @brief Streaming counters since dgus_audio_start()
+ */
+typedef struct dgus_audio_stats {
+  uint32_t bytes;               /**< PCM bytes sent */
+  uint16_t buffers;             /**< panel buffers played */
+  uint16_t underruns;           /**< times the panel ran dry with the stream still going */
+  uint16_t ring_size;           /**< host ring buffer size picked from the baud rate */
+} dgus_audio_stats;
+
+/**
+ * @brief Start streaming PCM from @p source
+ * Data is pulled into a host ring buffer holding AUDIO_RING_MS of link time, then sent in
+ * full frames into one of two panel buffers while the panel plays the other. The staged buffer
+ * is started as soon as the panel reports the playing one done, before more PCM is sent.
+ * Nothing is sent until dgus_audio_service() is called.
+ *
+ * @param byte_rate PCM bytes per second, e.g. 16000 for 8kHz 16 bit mono
+ * @param source callback producing PCM
+ * @param ctx passed to @p source
+ * @return #DGUS_RETURN #DGUS_AUDIO_RATE if the link cannot carry @p byte_rate
+ */
+DGUS_RETURN dgus_audio_start(uint32_t byte_rate, dgus_audio_source_cb source, void *ctx);
+
+/**
+ * @brief Move PCM from the producer to the panel and start the next buffer when one finishes
+ * Call this in your main loop, often enough to refill a buffer before the other one ends.
+ *
+ * @return #DGUS_RETURN
+ */
+DGUS_RETURN dgus_audio_service();
+
+/**
+ * @brief Stop streaming and tell the panel to stop playing
+ *
+ * @return #DGUS_RETURN of the stop command
+ */
+DGUS_RETURN dgus_audio_stop();
+
+/**
+ * @brief Whether a stream is still being sent or played
+ *
+ * @return uint8_t 1 until the last buffer has finished after #DGUS_AUDIO_EOF
+ */
+uint8_t dgus_audio_active();
+
+/**
+ * @brief Streaming counters
+ *
+ * @param stats filled with the counters
+ */
+void dgus_audio_get_stats(dgus_audio_stats *stats);
@@ -0,0 +1,359 @@
+/**
+ * @file dgus_canvas.c
+ * @author Barry Carter
+ * @date 01 Jan 2021
+ * @brief DGUS II LCD Retained canvas over basic graphic controls
+ */
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "dgus.h"
+#include "dgus_canvas.h"
+#include "dgus_alloc.h"
+
+#define CANVAS_KINDS     5
+#define CANVAS_NO_KIND   0xFF
+#define CANVAS_MAX_WORDS 5      /**< longest packet */
+#define CANVAS_MERGE_GAP 4      /**< frame overhead in words, clean gaps up to this are cheaper to resend */
+
+static const uint16_t _kind_cmd[CANVAS_KINDS] = { GRAPHIC_PIXEL, GRAPHIC_LINE, GRAPHIC_RECT, GRAPHIC_FILL_RECT, GRAPHIC_CIRCLE };
+static const uint8_t _kind_words[CANVAS_KINDS] = { 3, 5, 5, 5, 4 };
+
+typedef struct canvas_prim_t {
+  uint8_t kind;                 /**< index into _kind_cmd, CANVAS_NO_KIND when off the canvas */
+  uint16_t slot;                /**< packet index in the kind's list */
+  uint16_t packet[CANVAS_MAX_WORDS];
+  canvas_rect drawn;       /**< bounds of the packet */
+} canvas_prim; /**< One retained primitive */
+
+typedef struct canvas_layer_t {
+  graphic *g;
+  uint16_t *shadow;             /**< list words as last sent */
+  uint16_t capacity;
+  uint8_t synced;               /**< shadow matches the panel */
+  uint8_t dirty;                /**< list must be rebuilt */
+} canvas_layer; /**< The basic graphic control for one kind */
+
+struct canvas {
+  uint16_t count;
+  uint8_t dirty_count;
+  uint8_t dirty_closed;         /**< the rectangles belong to the last flush */
+  canvas_rect dirty[CANVAS_DIRTY_RECTS];
+  canvas_layer layers[CANVAS_KINDS];
+  canvas_prim prims[];
+};
+
+canvas *dgus_canvas_create(uint16_t primitives) {
+  canvas *c = dgus_calloc(1, sizeof(canvas) + primitives * sizeof(canvas_prim));
+  if (!c)
+    return NULL;
+
+  c->count = primitives;
+  for (uint16_t i = 0; i < primitives; i++)
+    c->prims[i].kind = CANVAS_NO_KIND;
+  return c;
+}
+
+static void _layer_free(canvas_layer *l) {
+  // newest first, so a static pool gets it back
+  dgus_free(l->shadow);
+  dgus_graphic_destroy(l->g);
+  l->shadow = NULL;
+  l->g = NULL;
+}
+
+void dgus_canvas_destroy(canvas *c) {
+  for (int k = CANVAS_KINDS - 1; k >= 0; k--)
+    _layer_free(&c->layers[k]);
+  dgus_free(c);
+}
+
+static int _kind_index(uint16_t cmd) {
+  for (int k = 0; k < CANVAS_KINDS; k++) {
+    if (_kind_cmd[k] == cmd)
+      return k;
+  }
+  return -1;
+}
+
+DGUS_RETURN dgus_canvas_bind(canvas *c, uint16_t kind, uint16_t vp, uint16_t words) {
+  int k = _kind_index(kind);
+  if (k < 0)
+    return DGUS_ERROR;
+
+  canvas_layer *l = &c->layers[k];
+  // rebinding within the memory the layer already has allocates nothing
+  if (!l->g || dgus_graphic_rebind(l->g, vp, words) != DGUS_OK) {
+    _layer_free(l);
+    l->g = dgus_graphic_create(vp, words);
+    l->shadow = dgus_calloc(words, sizeof(uint16_t));
+    if (!l->g || !l->shadow) {
+      _layer_free(l);
+      return DGUS_ERROR;
+    }
+  }
+
+  l->capacity = words;
+  l->synced = 0;
+  l->dirty = 1;
+  return DGUS_OK;
+}
+
+static uint32_t _area(const canvas_rect *r) {
+  return (uint32_t)(r->x1 - r->x0 + 1) * (r->y1 - r->y0 + 1);
+}
+
+static void _union(canvas_rect *a, const canvas_rect *b) {
+  if (b->x0 < a->x0) a->x0 = b->x0;
+  if (b->y0 < a->y0) a->y0 = b->y0;
+  if (b->x1 > a->x1) a->x1 = b->x1;
+  if (b->y1 > a->y1) a->y1 = b->y1;
+}
+
+static int _overlap(const canvas_rect *a, const canvas_rect *b) {
+  return a->x0 <= b->x1 && b->x0 <= a->x1 && a->y0 <= b->y1 && b->y0 <= a->y1;
+}
+
+static void _add_dirty(canvas *c, canvas_rect r) {
+  if (c->dirty_closed) {
+    c->dirty_count = 0;
+    c->dirty_closed = 0;
+  }
+
+  // absorb every rectangle the new one touches, the union may touch more
+  for (uint8_t i = 0; i < c->dirty_count;) {
+    if (_overlap(&r, &c->dirty[i])) {
+      _union(&r, &c->dirty[i]);
+      c->dirty[i] = c->dirty[--c->dirty_count];
+      i = 0;
+    }
+    else {
+      i++;
+    }
+  }
+
+  if (c->dirty_count < CANVAS_DIRTY_RECTS) {
+    c->dirty[c->dirty_count++] = r;
+    return;
+  }
+
+  // full, grow the rectangle that grows least
+  uint8_t best = 0;
+  uint32_t best_cost = UINT32_MAX;
+  for (uint8_t i = 0; i < c->dirty_count; i++) {
+    canvas_rect u = c->dirty[i];
+    _union(&u, &r);
+    uint32_t cost = _area(&u) - _area(&c->dirty[i]);
+    if (cost < best_cost) {
+      best_cost = cost;
+      best = i;
+    }
+  }
+  _union(&c->dirty[best], &r);
+}
+
+static canvas_rect _bounds(uint8_t k, const uint16_t *p) {
+  canvas_rect r;
+
+  switch (_kind_cmd[k]) {
+  case GRAPHIC_PIXEL:
+    r.x0 = r.x1 = p[0];
+    r.y0 = r.y1 = p[1];
+    break;
+  case GRAPHIC_LINE:
+    r.x0 = p[1] < p[3] ? p[1] : p[3];
+    r.x1 = p[1] < p[3] ? p[3] : p[1];
+    r.y0 = p[2] < p[4] ? p[2] : p[4];
+    r.y1 = p[2] < p[4] ? p[4] : p[2];
+    break;
+  case GRAPHIC_CIRCLE:
+    r.x0 = p[0] > p[2] ? p[0] - p[2] : 0;
+    r.y0 = p[1] > p[2] ? p[1] - p[2] : 0;
+    r.x1 = p[0] + p[2];
+    r.y1 = p[1] + p[2];
+    break;
+  default:
+    r.x0 = p[0] < p[2] ? p[0] : p[2];
+    r.x1 = p[0] < p[2] ? p[2] : p[0];
+    r.y0 = p[1] < p[3] ? p[1] : p[3];
+    r.y1 = p[1] < p[3] ? p[3] : p[1];
+    break;
+  }
+  return r;
+}
+
+void dgus_canvas_remove(canvas *c, uint16_t id) {
+  if (id >= c->count || c->prims[id].kind == CANVAS_NO_KIND)
+    return;
+
+  canvas_prim *p = &c->prims[id];
+  c->layers[p->kind].dirty = 1;
+  _add_dirty(c, p->drawn);
+  p->kind = CANVAS_NO_KIND;
+}
+
+/* Lowest slot no primitive of kind k holds */
+static uint16_t _free_slot(canvas *c, uint8_t k) {
+  uint16_t slot = 0;
+
+  for (uint16_t i = 0; i < c->count;) {
+    if (c->prims[i].kind == k && c->prims[i].slot == slot) {
+      slot++;
+      i = 0;
+    }
+    else {
+      i++;
+    }
+  }
+  return slot;
+}
+
+static DGUS_RETURN _set(canvas *c, uint16_t id, uint16_t cmd, const uint16_t *packet) {
+  int k = _kind_index(cmd);
+
+  if (id >= c->count || k < 0 || !c->layers[k].g)
+    return DGUS_ERROR;
+
+  canvas_prim *p = &c->prims[id];
+  uint8_t words = _kind_words[k];
+
+  if (p->kind == k && memcmp(p->packet, packet, words * sizeof(uint16_t)) == 0)
+    return DGUS_OK;
+
+  if (p->kind != k) {
+    uint16_t slot = _free_slot(c, k);
+    if (GRAPHIC_HEADER_WORDS + (slot + 1) * words + 1 > c->layers[k].capacity)
+      return DGUS_GRAPHIC_FULL;
+    dgus_canvas_remove(c, id);
+    p->kind = k;
+    p->slot = slot;
+  }
+  else {
+    _add_dirty(c, p->drawn);
+  }
+
+  memcpy(p->packet, packet, words * sizeof(uint16_t));
+  p->drawn = _bounds(k, packet);
+  _add_dirty(c, p->drawn);
+  c->layers[k].dirty = 1;
+  return DGUS_OK;
+}
+
+DGUS_RETURN dgus_canvas_pixel(canvas *c, uint16_t id, uint16_t x, uint16_t y, uint16_t colour) {
+  uint16_t p[] = { x, y, colour };
+  return _set(c, id, GRAPHIC_PIXEL, p);
+}
+
+DGUS_RETURN dgus_canvas_line(canvas *c, uint16_t id, uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1, uint16_t colour) {
+  uint16_t p[] = { colour, x0, y0, x1, y1 };
+  return _set(c, id, GRAPHIC_LINE, p);
+}
+
+DGUS_RETURN dgus_canvas_rect(canvas *c, uint16_t id, uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1, uint16_t colour) {
+  uint16_t p[] = { x0, y0, x1, y1, colour };
+  return _set(c, id, GRAPHIC_RECT, p);
+}
+
+DGUS_RETURN dgus_canvas_fill_rect(canvas *c, uint16_t id, uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1, uint16_t colour) {
+  uint16_t p[] = { x0, y0, x1, y1, colour };
+  return _set(c, id, GRAPHIC_FILL_RECT, p);
+}
+
+DGUS_RETURN dgus_canvas_circle(canvas *c, uint16_t id, uint16_t x, uint16_t y, uint16_t radius, uint16_t colour) {
+  uint16_t p[] = { x, y, radius, colour };
+  return _set(c, id, GRAPHIC_CIRCLE, p);
+}
+
+/* Lay the kind's packets out by slot. A free slot below the top repeats the first
+ * packet, drawing it twice changes nothing and keeps the other slots in place.
+ */
+static void _rebuild(canvas *c, uint8_t k) {
+  canvas_layer *l = &c->layers[k];
+  canvas_prim *first = NULL;
+  uint16_t slots = 0;
+
+  for (uint16_t i = 0; i < c->count; i++) {
+    canvas_prim *p = &c->prims[i];
+    if (p->kind != k)
+      continue;
+    if (p->slot + 1 > slots)
+      slots = p->slot + 1;
+    if (!first || p->slot < first->slot)
+      first = p;
+  }
+
+  dgus_graphic_clear(l->g);
+  for (uint16_t s = 0; s < slots; s++) {
+    canvas_prim *at = first;
+    for (uint16_t i = 0; i < c->count; i++) {
+      if (c->prims[i].kind == k && c->prims[i].slot == s) {
+        at = &c->prims[i];
+        break;
+      }
+    }
+    dgus_graphic_append(l->g, _kind_cmd[k], at->packet, _kind_words[k]);
+  }
+}
+
+/* Send the words that differ from the shadow, packets first and the header last */
+static DGUS_RETURN _sync(canvas_layer *l) {
+  DGUS_RETURN r = DGUS_OK;
+  uint16_t vp, used;
+  const uint16_t *w = dgus_graphic_words(l->g, &vp, &used);
+  int start = -1, last = -1;
+
+  for (uint16_t i = GRAPHIC_HEADER_WORDS; i <= used; i++) {
+    uint8_t changed = i < used && (!l->synced || w[i] != l->shadow[i]);
+
+    if (start >= 0 && (i == used || (changed && i - last - 1 > CANVAS_MERGE_GAP))) {
+      if (dgus_graphic_write(vp + start, &w[start], last - start + 1) != DGUS_OK)
+        r = DGUS_TIMEOUT;
+      start = -1;
+    }
+    if (changed) {
+      if (start < 0)
+        start = i;
+      last = i;
+    }
+  }
+
+  if (!l->synced || memcmp(w, l->shadow, GRAPHIC_HEADER_WORDS * sizeof(uint16_t)) != 0) {
+    if (dgus_graphic_write(vp, w, GRAPHIC_HEADER_WORDS) != DGUS_OK)
+      r = DGUS_TIMEOUT;
+  }
+
+  if (r == DGUS_OK) {
+    memcpy(l->shadow, w, used * sizeof(uint16_t));
+    l->synced = 1;
+  }
+  return r;
+}
+
+DGUS_RETURN dgus_canvas_flush(canvas *c) {
+  DGUS_RETURN r = DGUS_OK;
+
+  for (uint8_t k = 0; k < CANVAS_KINDS; k++) {
+    canvas_layer *l = &c->layers[k];
+    if (!l->g || !l->dirty)
+      continue;
+
+    _rebuild(c, k);
+    if (_sync(l) != DGUS_OK)
+      r = DGUS_TIMEOUT;
+    else
+      l->dirty = 0;
+  }
+
+  // nothing changed since the last flush
+  if (c->dirty_closed)
+    c->dirty_count = 0;
+  c->dirty_closed = 1;
+  return r;
+}
+
+uint8_t dgus_canvas_dirty(canvas *c, const canvas_rect **rects) {
+  *rects = c->dirty;
+  return c->dirty_closed ? c->dirty_count : 0;
+}
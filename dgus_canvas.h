@@ -0,0 +1,127 @@
+#pragma once
+/**
+ * @file dgus_canvas.h
+ * @author Barry Carter
+ * @date 01 Jan 2021
+ * @brief DGUS II LCD Retained canvas over basic graphic controls
+ */
+#include <stddef.h>
+#include <stdint.h>
+#include "dgus_reg.h"
+#include "dgus.h"
+#include "dgus_control_graphic.h"
+
+/**
+ * @brief Opaque reference to a canvas
+ */
+typedef struct canvas canvas;
+
+/**
+ * @brief A screen rectangle, corners included
+ */
+typedef struct canvas_rect_t {
+  uint16_t x0;
+  uint16_t y0;
+  uint16_t x1;
+  uint16_t y1;
+} canvas_rect;
+
+/**
+ * @brief Create a canvas of retained primitives
+ * Each primitive has an id and keeps a fixed packet slot in the display list of its kind,
+ * so a tick that moves one needle only sends that needle's packet.
+ *
+ * @param primitives number of primitive ids, 0 to @p primitives - 1
+ * @return canvas* Opaque reference to the canvas, or NULL on allocation failure
+ */
+canvas *dgus_canvas_create(uint16_t primitives);
+
+/**
+ * @brief Destroy a canvas and its display lists
+ * With DGUS_STATIC_ALLOC the pool gets the memory back only if nothing was allocated after the canvas
+ * and its kinds were bound in #graphic_cmd order, see dgus_free()
+ *
+ * @param c canvas
+ */
+void dgus_canvas_destroy(canvas *c);
+
+/**
+ * @brief Give a kind of primitive the basic graphic control that draws it
+ * Rebinding a kind to no more words than before reuses its memory.
+ *
+ * @param c canvas
+ * @param kind #graphic_cmd, not #GRAPHIC_NONE
+ * @param vp VP of the control
+ * @param words VP words the control owns
+ * @return DGUS_RETURN #DGUS_ERROR on an unknown kind or allocation failure
+ */
+DGUS_RETURN dgus_canvas_bind(canvas *c, uint16_t kind, uint16_t vp, uint16_t words);
+
+/**
+ * @brief Set primitive @p id to a pixel. Setting the same value again costs nothing
+ *
+ * @param c canvas
+ * @param id primitive id
+ * @param x x
+ * @param y y
+ * @param colour RGB565
+ * @return DGUS_RETURN #DGUS_GRAPHIC_FULL, #DGUS_ERROR on a bad id or an unbound kind
+ */
+DGUS_RETURN dgus_canvas_pixel(canvas *c, uint16_t id, uint16_t x, uint16_t y, uint16_t colour);
+
+/**
+ * @brief Set primitive @p id to a line segment
+ *
+ * @return DGUS_RETURN as dgus_canvas_pixel()
+ */
+DGUS_RETURN dgus_canvas_line(canvas *c, uint16_t id, uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1, uint16_t colour);
+
+/**
+ * @brief Set primitive @p id to a rectangle outline
+ *
+ * @return DGUS_RETURN as dgus_canvas_pixel()
+ */
+DGUS_RETURN dgus_canvas_rect(canvas *c, uint16_t id, uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1, uint16_t colour);
+
+/**
+ * @brief Set primitive @p id to a filled rectangle
+ *
+ * @return DGUS_RETURN as dgus_canvas_pixel()
+ */
+DGUS_RETURN dgus_canvas_fill_rect(canvas *c, uint16_t id, uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1, uint16_t colour);
+
+/**
+ * @brief Set primitive @p id to a circle outline
+ *
+ * @return DGUS_RETURN as dgus_canvas_pixel()
+ */
+DGUS_RETURN dgus_canvas_circle(canvas *c, uint16_t id, uint16_t x, uint16_t y, uint16_t radius, uint16_t colour);
+
+/**
+ * @brief Take primitive @p id off the canvas
+ *
+ * @param c canvas
+ * @param id primitive id
+ */
+void dgus_canvas_remove(canvas *c, uint16_t id);
+
+/**
+ * @brief Send what changed since the last flush
+ * Only the display list words of changed primitives go out, runs close together sharing a frame,
+ * and a header goes last when a packet count changed. The panel repaints the uncovered background
+ * of a basic graphic control itself, so no clear commands are needed.
+ *
+ * @param c canvas
+ * @return DGUS_RETURN #DGUS_TIMEOUT if any frame was not acknowledged
+ */
+DGUS_RETURN dgus_canvas_flush(canvas *c);
+
+/**
+ * @brief Screen areas changed by the last flush: where primitives were and where they are now
+ * Merged down to CANVAS_DIRTY_RECTS. Useful when other content, e.g. a JPEG, is drawn under the canvas.
+ *
+ * @param c canvas
+ * @param rects set to the rectangles
+ * @return uint8_t number of rectangles
+ */
+uint8_t dgus_canvas_dirty(canvas *c, const canvas_rect **rects);
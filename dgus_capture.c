@@ -0,0 +1,285 @@
+/**
+ * @file dgus_capture.c
+ * @author Barry Carter
+ * @date 01 Jan 2021
+ * @brief DGUS II LCD Serial traffic capture and replay
+ */
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+#include <stdatomic.h>
+#include "dgus.h"
+#include "dgus_capture.h"
+#if CAPTURE_POSIX_FD
+#include <unistd.h>
+#endif
+
+#define CAPTURE_VARINT_MAX 5    /**< LEB128 bytes for a u32 */
+
+static dgus_micros_cb _micros;
+
+/* Recording. Single producer (the serial path), single consumer (the flusher) */
+static uint8_t *_ring;
+static size_t _ring_len;
+static atomic_size_t _head;             /**< next byte the producer writes */
+static atomic_size_t _tail;             /**< next byte the flusher reads */
+static atomic_int _recording;
+static uint32_t _last_us;
+static uint32_t _dropped;
+static dgus_capture_sink_cb _sink;
+static void *_sink_ctx;
+
+/* Replay */
+static const uint8_t *_cap;
+static size_t _cap_len;
+static size_t _pos;
+static uint16_t _rec_left;              /**< received bytes left in the current record */
+static uint8_t _boundary;               /**< a record just ran out, the port read ended there */
+static uint32_t _cap_us;                /**< capture time of the current record */
+static uint16_t _speed;
+static uint8_t _started;
+static uint32_t _start_us;
+static uint32_t _replay_bytes;
+
+static uint32_t _clock_micros() {
+#ifdef CLOCK_MONOTONIC
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint32_t)((uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000);
+#else
+  // process time, it stands still while blocked. Set a real clock with dgus_capture_set_clock()
+  return (uint32_t)((uint64_t)clock() * 1000000 / CLOCKS_PER_SEC);
+#endif
+}
+
+static uint32_t _now() {
+  return _micros ? _micros() : _clock_micros();
+}
+
+void dgus_capture_set_clock(dgus_micros_cb micros) {
+  _micros = micros;
+}
+
+static size_t _ring_free() {
+  size_t head = atomic_load_explicit(&_head, memory_order_relaxed);
+  size_t tail = atomic_load_explicit(&_tail, memory_order_acquire);
+  return (tail + _ring_len - head - 1) % _ring_len;
+}
+
+static void _ring_put(const uint8_t *data, size_t len) {
+  size_t head = atomic_load_explicit(&_head, memory_order_relaxed);
+
+  for (size_t i = 0; i < len; i++)
+    _ring[(head + i) % _ring_len] = data[i];
+  atomic_store_explicit(&_head, (head + len) % _ring_len, memory_order_release);
+}
+
+DGUS_RETURN dgus_capture_start(uint8_t *ring, size_t len, dgus_capture_sink_cb sink, void *ctx) {
+  if (!ring || len < CAPTURE_HEADER_LEN + CAPTURE_MAX_RECORD + 1 + CAPTURE_VARINT_MAX + 1)
+    return DGUS_ERROR;
+
+  atomic_store(&_recording, 0);
+  _ring = ring;
+  _ring_len = len;
+  atomic_store(&_head, 0);
+  atomic_store(&_tail, 0);
+  _sink = sink;
+  _sink_ctx = ctx;
+  _dropped = 0;
+  _last_us = _now();
+
+  uint8_t h[CAPTURE_HEADER_LEN] = {
+    CAPTURE_MAGIC & 0xFF, (CAPTURE_MAGIC >> 8) & 0xFF, (CAPTURE_MAGIC >> 16) & 0xFF, CAPTURE_MAGIC >> 24,
+    CAPTURE_VERSION, 0, 0, 0
+  };
+  _ring_put(h, sizeof(h));
+  atomic_store(&_recording, 1);
+  return DGUS_OK;
+}
+
+void dgus_capture_stop() {
+  atomic_store(&_recording, 0);
+}
+
+uint32_t dgus_capture_dropped() {
+  return _dropped;
+}
+
+void dgus_capture_record(uint8_t tag, const uint8_t *data, size_t len) {
+  if (!atomic_load_explicit(&_recording, memory_order_relaxed))
+    return;
+
+  uint32_t now = _now();
+
+  while (len) {
+    size_t n = len > CAPTURE_MAX_RECORD ? CAPTURE_MAX_RECORD : len;
+    uint8_t rec[1 + CAPTURE_VARINT_MAX + CAPTURE_MAX_RECORD];
+    uint8_t hl = 0;
+    uint32_t delta = now - _last_us;
+
+    rec[hl++] = tag | (n - 1);
+    do {
+      rec[hl] = delta & 0x7F;
+      delta >>= 7;
+      if (delta)
+        rec[hl] |= 0x80;
+      hl++;
+    } while (delta);
+
+    if (_ring_free() < hl + n) {
+      _dropped += len;
+      return;
+    }
+
+    // one put, so the flusher never sees half a record
+    memcpy(&rec[hl], data, n);
+    _ring_put(rec, hl + n);
+
+    _last_us = now;
+    data += n;
+    len -= n;
+  }
+}
+
+size_t dgus_capture_flush() {
+  size_t total = 0;
+
+  if (!_ring || !_sink)
+    return 0;
+
+  for (;;) {
+    size_t head = atomic_load_explicit(&_head, memory_order_acquire);
+    size_t tail = atomic_load_explicit(&_tail, memory_order_relaxed);
+    if (head == tail)
+      break;
+
+    // up to the end of the ring, the wrapped part goes next time round
+    size_t n = head > tail ? head - tail : _ring_len - tail;
+    size_t w = _sink(&_ring[tail], n, _sink_ctx);
+    atomic_store_explicit(&_tail, (tail + w) % _ring_len, memory_order_release);
+    total += w;
+    if (w < n)
+      break;
+  }
+  return total;
+}
+
+#if CAPTURE_POSIX_FD
+size_t dgus_capture_fd_sink(const uint8_t *buf, size_t len, void *ctx) {
+  ssize_t n = write(*(int *)ctx, buf, len);
+  return n < 0 ? 0 : n;
+}
+#endif
+
+/* Replay */
+
+DGUS_RETURN dgus_replay_open(const uint8_t *cap, size_t len, uint16_t speed) {
+  if (len < CAPTURE_HEADER_LEN)
+    return DGUS_ERROR;
+
+  uint32_t magic = cap[0] | (cap[1] << 8) | (cap[2] << 16) | ((uint32_t)cap[3] << 24);
+  if (magic != CAPTURE_MAGIC || cap[4] != CAPTURE_VERSION)
+    return DGUS_ERROR;
+
+  _cap = cap;
+  _cap_len = len;
+  _pos = CAPTURE_HEADER_LEN;
+  _rec_left = 0;
+  _boundary = 0;
+  _cap_us = 0;
+  _speed = speed;
+  _started = 0;
+  _replay_bytes = 0;
+  return DGUS_OK;
+}
+
+/* Move to the next record of received bytes, keeping time across sent ones */
+static uint8_t _replay_next() {
+  while (_pos < _cap_len) {
+    uint8_t tag = _cap[_pos++];
+    uint32_t delta = 0;
+
+    for (uint8_t shift = 0; _pos < _cap_len && shift < 7 * CAPTURE_VARINT_MAX; shift += 7) {
+      uint8_t b = _cap[_pos++];
+      delta |= (uint32_t)(b & 0x7F) << shift;
+      if (!(b & 0x80))
+        break;
+    }
+    _cap_us += delta;
+
+    uint16_t n = (tag & 0x7F) + 1;
+    if (_pos + n > _cap_len) {
+      // cut short, e.g. the recorder was still running
+      _pos = _cap_len;
+      break;
+    }
+    if (tag & CAPTURE_TAG_RX) {
+      _rec_left = n;
+      return 1;
+    }
+    _pos += n;
+  }
+  return 0;
+}
+
+uint8_t dgus_replay_available() {
+  if (!_cap)
+    return 0;
+  // one record per poll, as the bytes originally arrived, so bursts are parsed the same way
+  if (_boundary)
+    return 0;
+  if (_rec_left == 0 && !_replay_next())
+    return 0;
+
+  if (!_started) {
+    _started = 1;
+    _start_us = _now() - _cap_us / (_speed ? _speed : 1);
+  }
+  if (_speed && (uint64_t)(_now() - _start_us) * _speed < _cap_us)
+    return 0;
+
+  return _rec_left > 0xFF ? 0xFF : _rec_left;
+}
+
+char dgus_replay_recv() {
+  if (_rec_left == 0 && !dgus_replay_available())
+    return 0;
+
+  if (--_rec_left == 0)
+    _boundary = 1;
+  _replay_bytes++;
+  return _cap[_pos++];
+}
+
+void dgus_replay_send(char *data, size_t len) {
+  (void)data;
+  (void)len;
+  // the application answered, let the captured reply through
+  _boundary = 0;
+}
+
+uint8_t dgus_replay_done() {
+  _boundary = 0;
+  return !_cap || (_rec_left == 0 && !_replay_next());
+}
+
+DGUS_RETURN dgus_replay_run(dgus_replay_stats *stats) {
+  if (!_cap)
+    return DGUS_ERROR;
+
+  uint32_t start = _now();
+
+  while (!dgus_replay_done())
+    dgus_recv_data();
+  // frames still staged
+  while (dgus_recv_data() > 0)
+    ;
+
+  stats->bytes = _replay_bytes;
+  stats->capture_us = _cap_us;
+  stats->elapsed_us = _now() - start;
+  return DGUS_OK;
+}
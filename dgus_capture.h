@@ -0,0 +1,146 @@
+#pragma once
+/**
+ * @file dgus_capture.h
+ * @author Barry Carter
+ * @date 01 Jan 2021
+ * @brief DGUS II LCD Serial traffic capture and replay
+ *
+ * Capture format, little endian:
+ * - header: magic "DCAP", u8 version, u8 flags, u16 reserved
+ * - records: u8 tag, LEB128 microseconds since the previous record, then the bytes.
+ *   Tag bit 7 is set for received bytes, bits 0-6 hold the byte count - 1.
+ */
+#include <stddef.h>
+#include <stdint.h>
+#include "dgus_reg.h"
+#include "dgus.h"
+
+#define CAPTURE_MAGIC      0x50414344   /**< "DCAP" */
+#define CAPTURE_VERSION    1
+#define CAPTURE_HEADER_LEN 8
+#define CAPTURE_TAG_RX     0x80         /**< record holds received bytes */
+#define CAPTURE_MAX_RECORD 128          /**< bytes per record, longer transfers are split */
+
+/**
+ * @brief Monotonic microsecond clock. On Arduino like platforms this would be micros()
+ */
+typedef uint32_t (*dgus_micros_cb)(void);
+
+/**
+ * @brief Where dgus_capture_flush() writes the capture, e.g. a file
+ *
+ * @param buf capture bytes
+ * @param len byte count
+ * @param ctx context given to dgus_capture_start()
+ * @return size_t bytes written. Fewer leave the rest for the next flush
+ */
+typedef size_t (*dgus_capture_sink_cb)(const uint8_t *buf, size_t len, void *ctx);
+
+/**
+ * @brief Result of dgus_replay_run()
+ */
+typedef struct dgus_replay_stats {
+  uint32_t bytes;               /**< received bytes fed to the parser */
+  uint32_t capture_us;          /**< time the capture covered */
+  uint32_t elapsed_us;          /**< time the replay took */
+} dgus_replay_stats;
+
+/**
+ * @brief Start recording every byte sent and received
+ * The serial path only copies records into @p ring. A background thread, or the main loop,
+ * writes them out with dgus_capture_flush(). Records that do not fit are dropped and counted.
+ *
+ * @param ring ring buffer memory, at least CAPTURE_HEADER_LEN + CAPTURE_MAX_RECORD + 6 bytes
+ * @param len ring size in bytes
+ * @param sink output for dgus_capture_flush()
+ * @param ctx passed to @p sink
+ * @return DGUS_RETURN #DGUS_ERROR if @p ring is too small
+ */
+DGUS_RETURN dgus_capture_start(uint8_t *ring, size_t len, dgus_capture_sink_cb sink, void *ctx);
+
+/**
+ * @brief Stop recording. Call dgus_capture_flush() afterwards for the rest
+ */
+void dgus_capture_stop();
+
+/**
+ * @brief Write recorded bytes to the sink. Safe to call from one thread while another does serial I/O
+ *
+ * @return size_t bytes written
+ */
+size_t dgus_capture_flush();
+
+/**
+ * @brief Bytes of traffic lost because the ring was full
+ *
+ * @return uint32_t count since dgus_capture_start()
+ */
+uint32_t dgus_capture_dropped();
+
+/**
+ * @brief Replace the clock used for timestamps and replay pacing
+ * Defaults to CLOCK_MONOTONIC where the platform has it. Elsewhere set one, clock() is only a fallback
+ *
+ * @param micros microsecond clock, NULL for the default
+ */
+void dgus_capture_set_clock(dgus_micros_cb micros);
+
+/**
+ * @brief Load a capture to replay. Pass dgus_replay_available(), dgus_replay_recv() and
+ * dgus_replay_send() to dgus_init() and loop on dgus_replay_done() and dgus_recv_data(), or use dgus_replay_run()
+ * One received record is released per dgus_replay_done() call, as one read saw it live.
+ *
+ * @param cap capture bytes, e.g. a mapped file. Must stay valid during the replay
+ * @param len capture size
+ * @param speed 1 for the original timing, N for N times faster, 0 for no waiting at all
+ * @return DGUS_RETURN #DGUS_ERROR if this is not a capture
+ */
+DGUS_RETURN dgus_replay_open(const uint8_t *cap, size_t len, uint16_t speed);
+
+/**
+ * @brief Replay transport: received bytes whose time has come
+ */
+uint8_t dgus_replay_available();
+
+/**
+ * @brief Replay transport: next received byte
+ */
+char dgus_replay_recv();
+
+/**
+ * @brief Replay transport: sent bytes are dropped, the replies are already in the capture
+ */
+void dgus_replay_send(char *data, size_t len);
+
+/**
+ * @brief Whether every received byte has been handed out. Call once per main loop pass
+ *
+ * @return uint8_t 1 at the end of the capture
+ */
+uint8_t dgus_replay_done();
+
+/**
+ * @brief Feed the whole capture through dgus_recv_data() and time it
+ * Use speed 0 to benchmark the parser and handlers.
+ *
+ * @param stats filled with the counters
+ * @return DGUS_RETURN #DGUS_ERROR without an open capture
+ */
+DGUS_RETURN dgus_replay_run(dgus_replay_stats *stats);
+
+#if CAPTURE_POSIX_FD
+/**
+ * @brief Sink writing to a file descriptor. Pass a pointer to the descriptor as the sink ctx
+ */
+size_t dgus_capture_fd_sink(const uint8_t *buf, size_t len, void *ctx);
+#endif
+
+/* internal */
+/**
+ * @brief Record bytes on the wire. Called from the send and receive paths
+ *
+ * @param tag 0 for sent bytes, #CAPTURE_TAG_RX for received
+ * @param data bytes
+ * @param len byte count
+ */
+void dgus_capture_record(uint8_t tag, const uint8_t *data, size_t len);
@@ -3,8 +3,60 @@
 #define SEND_TIMEOUT        200
 #define ACK_MODE            ACK_MODE_OK_WAIT
 #define RECV_BUFFER_SIZE    32
+#define RECV_STAGING_SIZE   64  /* raw bytes held while framing, at least RECV_BUFFER_SIZE + 4 */
 #define SEND_BUFFER_SIZE    32
+#define PACKET_POOL_SIZE    4   /* packets that can be built at once, see dgus_packet_acquire() */
 #define DEBUG_PRINT_ENABLED 1
+#ifndef DGUS_STATIC_ALLOC
+#define DGUS_STATIC_ALLOC   0   /* 1 for a heap free build, objects come from a static pool */
+#endif
+#define DGUS_POOL_BYTES     4096 /* the static object pool, or give your own to dgus_pool_init() */
+#define CURVE_LOG_MMAP      0   /* 1 to build the mmap backed curve log helpers (POSIX only) */
+#define TEXT_CACHE_ENTRIES  16  /* text fields remembered for dgus_set_text_delta() */
+#define TEXT_CACHE_FIELD_LEN 32 /* longest text field the delta cache will hold */
+#define TEXT_DELTA_MERGE_GAP 6  /* unchanged words worth resending to save a frame */
+#define TEXT_ENCODING_CACHE 8   /* text SP encodings remembered for dgus_set_text_utf8() */
+#define TEXT_TRANSCODE_GBK  1   /* 0 to drop the ~46KB Unicode to GBK/GB2312 table */
+#define PAGE_PROFILE_ENTRIES 64 /* VPs that can be registered across all page profiles */
+#define PAGE_MAP_ENTRIES    64  /* VP ranges that can be mapped to pages for lazy updates */
+#define PAGE_SHADOW_WORDS   512 /* words of shadow memory backing the mapped ranges */
+#define DISPATCH_MAX_HANDLERS 32 /* VP ranges that can be routed by dgus_dispatch_packet() */
+#define EVENT_QUEUE_ENTRIES 8   /* packets queued for the handler, 0 calls it from inside the parser */
+#define TX_QUEUE_FRAMES     16  /* writes each of the normal and bulk classes can hold back */
+#define TX_BUCKET_BYTES     128 /* link budget that can build up while idle */
+#define TX_INTERACTIVE_RESERVE 40 /* budget bulk writes always leave for touch feedback */
+#define BAUD_PROBES         3   /* round trips that must succeed after dgus_set_baud() */
+#define BAUD_SETTLE_MS      10  /* wait after the rate write before the ACK is discarded */
+#define FLASH_WINDOW_VP     0xF000 /* VAR space flash data is staged through, keep it free of controls */
+#define FLASH_WINDOW_WORDS  256 /* staging window, split in two halves for overlap */
+#define FLASH_NOR_WORDS     0x28000 /* NOR flash database size in words, 0x028000 on T5L */
+#define FLASH_POLL_LIMIT    500 /* completion polls before a flash copy is given up on */
+#define KV_MAX_KEYS         64  /* keys the key-value store index can hold */
+#define KV_INLINE_BYTES     8   /* values up to this size are kept in RAM for gets */
+#define KV_BATCH_WORDS      64  /* puts buffered per flash write, also bounds a record */
+#define KV_SCAN_WORDS       128 /* flash read size while mounting */
+#define KV_COMPACT_PERCENT  75  /* active half fill that starts background compaction */
+#define KV_COMPACT_STEP     4   /* records copied per dgus_kv_service() call */
+#define UPLOAD_WINDOW_A     0x8000 /* VAR windows uploads are staged through, each holds a 32KB block */
+#define UPLOAD_WINDOW_B     0xC000
+#define UPLOAD_RETRIES      3   /* times a block is resent after a CRC mismatch */
+#define JPEG_SLOT_A         0x8000 /* VAR slots JPEGs are staged through, shared with the upload windows */
+#define JPEG_SLOT_B         0xC000
+#define JPEG_SLOT_WORDS     0x4000 /* largest JPEG in words */
+#define JPEG_POSIX_FD       0   /* 1 to build dgus_jpeg_show_fd() (POSIX only) */
+#define AUDIO_BUF_A         0x8000 /* VAR buffers the panel plays streamed PCM from, shared with the upload windows */
+#define AUDIO_BUF_B         0xC000
+#define AUDIO_BUF_WORDS     0x800 /* PCM words per panel buffer */
+#define AUDIO_RING_MS       100 /* link time the host ring buffer holds, sized from the baud rate */
+#define AUDIO_RING_BYTES    4096 /* largest host ring buffer */
+#define AUDIO_POLL_LEAD_MS  10  /* how early before a buffer should end its completion is polled */
+#define CANVAS_DIRTY_RECTS  8   /* dirty rectangles a canvas reports before merging them */
+#define WATCH_MAX_ENTRIES   16  /* VP ranges dgus_watch_service() can poll */
+#define WATCH_ENTRY_WORDS   4   /* longest watched range in words */
+#define WATCH_MERGE_GAP     4   /* unwatched words worth reading to save a round trip */
+#define WATCH_BACKOFF_MAX   8   /* an unchanging value is polled down to 1/8 of its rate, 1 disables */
+#define CAPTURE_ENABLED     1   /* 0 to compile out the traffic capture hooks */
+#define CAPTURE_POSIX_FD    0   /* 1 to build dgus_capture_fd_sink() (POSIX only) */
 
 //#define DEBUG_PRINTF(...) {}
 #define DEBUG_PRINTF(...) { printf(__VA_ARGS__); }
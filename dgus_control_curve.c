@@ -10,8 +10,33 @@
 #include <stdint.h>
 #include <stddef.h>
 #include <time.h> 
+#include <stdatomic.h>
 #include "dgus.h"
 #include "dgus_control_curve.h"
+#include "dgus_alloc.h"
+#if CURVE_LOG_MMAP
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+#define CURVE_FRAME_HEADER_LEN 6   /**< address, 5aa5 header, channel count and pad byte */
+#define CURVE_FRAME_MAX_LEN    (SEND_BUFFER_SIZE < 248 ? SEND_BUFFER_SIZE : 248) /**< payload bytes that fit one frame */
+
+typedef struct curve_log_header_t {
+  uint32_t magic;
+  uint16_t window;
+  uint8_t channel_count;
+  uint8_t reserved;
+} curve_log_header; /**< Start of the replay log memory */
+
+typedef struct curve_log_channel_t {
+  uint8_t channel_id;
+  uint8_t reserved;
+  uint16_t head;                /**< next slot to write */
+  uint16_t count;               /**< valid samples, up to window */
+  uint16_t samples[];
+} curve_log_channel; /**< Per channel ring, window samples follow */
 
 typedef struct curve_data_t {
   uint8_t channel_id;
@@ -23,19 +48,72 @@ typedef struct curve_data_t {
 struct curve {
   uint8_t channel_count;
   uint8_t _initted_count;
+  curve_log_header *log;
   curve_data curves[];
 };
 
+typedef struct curve_sample_t {
+  atomic_uint_least32_t seq;     /**< slot sequence. Equals the ticket when free, ticket + 1 when filled */
+  uint8_t channel_id;
+  uint16_t data;
+  uint32_t timestamp;
+} curve_sample; /**< One queued sample in the ingestion ring */
+
+struct curve_ingest {
+  curve *cur;
+  uint32_t mask;
+  atomic_uint_least32_t head;    /**< next ticket handed to a producer */
+  uint32_t tail;                /**< next ticket read by the flusher */
+  uint32_t timestamps[CURVE_MAX_CHANNELS];
+  curve_sample slots[];
+};
+
 /* This is the terse format for updating the curves. Seemingly not working on my devices */
 typedef struct __attribute__((packed)) dgus_curve_data_t {
   uint8_t channels; // bit field of channels to update
   uint16_t data[16];
 } dgus_curve_data; /**< Curve packet format data */
 
+static curve_log_channel *_log_channel(curve_log_header *log, uint8_t idx) {
+  size_t stride = sizeof(curve_log_channel) + sizeof(uint16_t) * log->window;
+  return (curve_log_channel *)((uint8_t *)log + sizeof(curve_log_header) + stride * idx);
+}
+
+/* Append what was just sent on channel slot idx to its ring */
+static void _log_record(curve *cur, uint8_t idx) {
+  curve_data *cd = &cur->curves[idx];
+  curve_log_channel *lc = _log_channel(cur->log, idx);
+  uint16_t window = cur->log->window;
+
+  lc->channel_id = cd->channel_id;
+  for (int i = 0; i < cd->used_words; i++) {
+    lc->samples[lc->head] = cd->data[i];
+    lc->head = (lc->head + 1) % window;
+    if (lc->count < window)
+      lc->count++;
+  }
+}
+
+/* Start a curve write frame: address, 5aa5 and a channel count to be patched later */
+static dgus_packet *_curve_frame_begin() {
+  dgus_packet *d = dgus_packet_acquire();
+  if (!d)
+    return NULL;
+  uint16_t temp16 = CURVE_ADDRESS;
+  uint8_t temp8 = 0;
+
+  buffer_u16(d, &temp16, 1);
+  temp16 = CURVE_HEADER;
+  buffer_u16(d, &temp16, 1);
+  buffer_u8(d, &temp8, 1);
+  buffer_u8(d, &temp8, 1);
+  return d;
+}
+
 curve *dgus_curve_buffer_create(uint8_t num_curves, uint8_t datapoint_buffer_len) {
   size_t sz = sizeof(curve) + 
               (sizeof(curve_data) * num_curves);
-  curve *c = calloc(1, sz);
+  curve *c = dgus_calloc(1, sz);
   DEBUG_PRINTF("SZ %ld\n", sz);
   if (!c)
     return NULL;
@@ -48,18 +126,27 @@ curve *dgus_curve_buffer_create(uint8_t num_curves, uint8_t datapoint_buffer_len
   return c;
 }
 
-void dgus_curve_init_channel(curve *cur, uint8_t channel_id) {
-  cur->curves[cur->_initted_count].channel_id = channel_id;
-  cur->curves[cur->_initted_count].data = calloc(1, sizeof(uint16_t) * cur->curves[cur->_initted_count].capacity_words);
+DGUS_RETURN dgus_curve_init_channel(curve *cur, uint8_t channel_id) {
+  if (cur->_initted_count >= cur->channel_count)
+    return DGUS_ERROR;
+
+  curve_data *cd = &cur->curves[cur->_initted_count];
+  cd->data = dgus_calloc(1, sizeof(uint16_t) * cd->capacity_words);
+  // the channel is not counted, so dgus_curve_add_data() never reaches the missing buffer
+  if (!cd->data)
+    return DGUS_NO_MEMORY;
+
+  cd->channel_id = channel_id;
   cur->_initted_count++;
-  return;
+  return DGUS_OK;
 }
 
 void dgus_curve_destroy(curve *cur) {
-  for (int i = 0; i < cur->channel_count; i++) {
-      free(cur->curves[i].data);
+  // newest first, so a static pool gets everything back
+  for (int i = cur->channel_count - 1; i >= 0; i--) {
+      dgus_free(cur->curves[i].data);
   }
-  free(cur);
+  dgus_free(cur);
 }
 
 DGUS_RETURN dgus_curve_add_data(curve *cur, uint8_t chan_id, uint16_t data) {
@@ -79,7 +166,9 @@ DGUS_RETURN dgus_curve_add_data(curve *cur, uint8_t chan_id, uint16_t data) {
 DGUS_RETURN dgus_curve_send_data(curve *cur) {
   // build a packet with all of the data for the curve processor
 
-  dgus_packet *d = dgus_packet_init();
+  dgus_packet *d = dgus_packet_acquire();
+  if (!d)
+    return DGUS_PACKET_POOL_EMPTY;
   // write the Address
   uint16_t temp16 = 0;
   uint8_t temp8 = 0;
@@ -99,32 +188,259 @@ DGUS_RETURN dgus_curve_send_data(curve *cur) {
 
   // write each channel and the data
   // [chanid][words][data word]...
+  uint8_t sent = 0;
   for (int i = 0; i < cur->_initted_count; i++) {
     
     curve_data *cd = &cur->curves[i];
-    if (cd->used_words == 0) {
-      DEBUG_PRINTF("C \n");
-      temp8 = cur->_initted_count - 1;
-      // decrement the amount of channels we are sending
-      dgus_packet_set_data(d, 4, &temp8, 1);
-      //d->data.cdata[4] = cur->_initted_count - 1; 
+    if (cd->used_words == 0)
       continue;
-    }
 
     buffer_u8(d, &cd->channel_id, 1);
     // word count
     buffer_u8(d, &cd->used_words, 1);
     // data
     buffer_u16(d, cd->data, cd->used_words);
+    sent++;
+  }
+
+  if (sent == 0) {
+    dgus_packet_release(d);
+    return DGUS_OK;
   }
-  
-  send_data(DGUS_CMD_VAR_W, d);
+
+  // skipped channels are not part of the payload, fix up the channel count
+  dgus_packet_set_data(d, 4, &sent, 1);
+
+  DGUS_RETURN r = dgus_packet_send(DGUS_CMD_VAR_W, d);
 
   for (int i = 0; i < cur->_initted_count; i++) {
+    if (cur->log)
+      _log_record(cur, i);
     cur->curves[i].used_words = 0;
   }
+
+  return r;
 }
 
 DGUS_RETURN dgus_curve_reset(curve *cur, uint8_t chan_id) {
   // actually not clear what to do here. 
-}
\ No newline at end of file
+}
+
+/* Lock-free MPSC ingestion.
+ * Bounded ring of sequenced slots. Producers claim a ticket with a CAS on head,
+ * fill the slot and publish it by bumping the slot sequence. The single flusher
+ * consumes in ticket order and hands the slot back for the next lap.
+ */
+curve_ingest *dgus_curve_ingest_create(curve *cur, uint16_t capacity) {
+  uint32_t sz = 2;
+  while (sz < capacity)
+    sz <<= 1;
+
+  curve_ingest *q = dgus_calloc(1, sizeof(curve_ingest) + sizeof(curve_sample) * sz);
+  if (!q)
+    return NULL;
+
+  q->cur = cur;
+  q->mask = sz - 1;
+  atomic_init(&q->head, 0);
+  for (uint32_t i = 0; i < sz; i++) {
+    atomic_init(&q->slots[i].seq, i);
+  }
+
+  return q;
+}
+
+void dgus_curve_ingest_destroy(curve_ingest *q) {
+  dgus_free(q);
+}
+
+DGUS_RETURN dgus_curve_ingest_push(curve_ingest *q, uint8_t chan_id, uint16_t data, uint32_t timestamp) {
+  uint32_t pos = atomic_load_explicit(&q->head, memory_order_relaxed);
+  curve_sample *s;
+
+  for (;;) {
+    s = &q->slots[pos & q->mask];
+    uint32_t seq = atomic_load_explicit(&s->seq, memory_order_acquire);
+    int32_t dif = (int32_t)(seq - pos);
+
+    if (dif == 0) {
+      // slot is free for this ticket, try to claim it
+      uint_least32_t expected = pos;
+      if (atomic_compare_exchange_weak_explicit(&q->head, &expected, pos + 1,
+                                                memory_order_relaxed, memory_order_relaxed))
+        break;
+      pos = expected;
+    }
+    else if (dif < 0) {
+      // the flusher has not consumed this slot from the previous lap
+      return DGUS_CURVE_BUFFER_FULL;
+    }
+    else {
+      // another producer beat us to it
+      pos = atomic_load_explicit(&q->head, memory_order_relaxed);
+    }
+  }
+
+  s->channel_id = chan_id;
+  s->data = data;
+  s->timestamp = timestamp;
+  atomic_store_explicit(&s->seq, pos + 1, memory_order_release);
+
+  return DGUS_OK;
+}
+
+DGUS_RETURN dgus_curve_ingest_flush(curve_ingest *q) {
+  DGUS_RETURN r = DGUS_OK;
+
+  for (;;) {
+    curve_sample *s = &q->slots[q->tail & q->mask];
+    uint32_t seq = atomic_load_explicit(&s->seq, memory_order_acquire);
+    if ((int32_t)(seq - (q->tail + 1)) < 0)
+      break; // empty, or the producer has not published yet
+
+    uint8_t chan_id = s->channel_id;
+    uint16_t data = s->data;
+    uint32_t timestamp = s->timestamp;
+    atomic_store_explicit(&s->seq, q->tail + q->mask + 1, memory_order_release);
+    q->tail++;
+
+    DGUS_RETURN ar = dgus_curve_add_data(q->cur, chan_id, data);
+    if (ar == DGUS_CURVE_BUFFER_FULL) {
+      // channel buffer is full, push out a frame and retry
+      DGUS_RETURN sr = dgus_curve_send_data(q->cur);
+      if (r == DGUS_OK)
+        r = sr;
+      ar = dgus_curve_add_data(q->cur, chan_id, data);
+    }
+
+    // keep the first error, a later success must not hide it
+    if (ar != DGUS_OK) {
+      if (r == DGUS_OK)
+        r = ar;
+      continue;
+    }
+
+    if (chan_id < CURVE_MAX_CHANNELS)
+      q->timestamps[chan_id] = timestamp;
+  }
+
+  DGUS_RETURN sr = dgus_curve_send_data(q->cur);
+  return r != DGUS_OK ? r : sr;
+}
+
+uint32_t dgus_curve_ingest_timestamp(curve_ingest *q, uint8_t chan_id) {
+  if (chan_id >= CURVE_MAX_CHANNELS)
+    return 0;
+
+  return q->timestamps[chan_id];
+}
+
+/* Replay log */
+size_t dgus_curve_log_size(uint8_t num_curves, uint16_t window) {
+  return sizeof(curve_log_header) +
+         (sizeof(curve_log_channel) + sizeof(uint16_t) * window) * num_curves;
+}
+
+DGUS_RETURN dgus_curve_log_attach(curve *cur, void *mem, size_t len, uint16_t window) {
+  curve_log_header *log = mem;
+
+  if (!mem || window == 0 || len < dgus_curve_log_size(cur->channel_count, window))
+    return DGUS_ERROR;
+
+  // keep an existing log with the same geometry, it holds the history we want to replay
+  if (log->magic != CURVE_LOG_MAGIC || log->window != window || log->channel_count != cur->channel_count) {
+    memset(mem, 0, dgus_curve_log_size(cur->channel_count, window));
+    log->magic = CURVE_LOG_MAGIC;
+    log->window = window;
+    log->channel_count = cur->channel_count;
+  }
+
+  cur->log = log;
+  return DGUS_OK;
+}
+
+DGUS_RETURN dgus_curve_replay(curve *cur) {
+  curve_log_header *log = cur->log;
+  DGUS_RETURN r = DGUS_OK;
+
+  if (!log)
+    return DGUS_ERROR;
+
+  dgus_packet *d = NULL;
+  uint16_t used = 0;
+  uint8_t chans = 0;
+
+  for (int i = 0; i < log->channel_count; i++) {
+    curve_log_channel *lc = _log_channel(log, i);
+    // oldest sample first
+    uint16_t pos = (lc->head + log->window - lc->count) % log->window;
+    uint16_t left = lc->count;
+
+    while (left) {
+      // channel id + word count + at least one sample
+      if (d && used + 4 > CURVE_FRAME_MAX_LEN) {
+        dgus_packet_set_data(d, 4, &chans, 1);
+        if (dgus_packet_send(DGUS_CMD_VAR_W, d) != DGUS_OK)
+          r = DGUS_TIMEOUT;
+        d = NULL;
+      }
+      if (!d) {
+        d = _curve_frame_begin();
+        if (!d)
+          return DGUS_PACKET_POOL_EMPTY;
+        used = CURVE_FRAME_HEADER_LEN;
+        chans = 0;
+      }
+
+      uint16_t n = (CURVE_FRAME_MAX_LEN - used - 2) / 2;
+      if (n > left)
+        n = left;
+      if (n > 0xFF)
+        n = 0xFF;
+
+      uint8_t n8 = n;
+      buffer_u8(d, &lc->channel_id, 1);
+      buffer_u8(d, &n8, 1);
+      for (int j = 0; j < n; j++) {
+        buffer_u16(d, &lc->samples[pos], 1);
+        pos = (pos + 1) % log->window;
+      }
+      used += 2 + n * 2;
+      left -= n;
+      chans++;
+    }
+  }
+
+  if (d) {
+    dgus_packet_set_data(d, 4, &chans, 1);
+    if (dgus_packet_send(DGUS_CMD_VAR_W, d) != DGUS_OK)
+      r = DGUS_TIMEOUT;
+  }
+
+  return r;
+}
+
+#if CURVE_LOG_MMAP
+void *dgus_curve_log_map_file(const char *path, size_t len) {
+  int fd = open(path, O_RDWR | O_CREAT, 0644);
+  if (fd < 0)
+    return NULL;
+
+  if (ftruncate(fd, len) != 0) {
+    close(fd);
+    return NULL;
+  }
+
+  void *mem = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  // the mapping holds its own reference to the file
+  close(fd);
+  if (mem == MAP_FAILED)
+    return NULL;
+
+  return mem;
+}
+
+void dgus_curve_log_unmap(void *mem, size_t len) {
+  munmap(mem, len);
+}
+#endif
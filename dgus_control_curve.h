@@ -17,8 +17,19 @@
  */
 typedef struct curve curve;
 
+/**
+ * @brief Opaque reference to a multi-producer sample ingestion queue
+ */
+typedef struct curve_ingest curve_ingest;
+
+/**
+ * @brief Magic at the start of a curve replay log, "CLOG"
+ */
+#define CURVE_LOG_MAGIC 0x474F4C43
+
 #define CURVE_ADDRESS 0x0310   /**< VAR address to write each datapoint to */
 #define CURVE_HEADER  0x5AA5   /**< CMD header to enable write mode */
+#define CURVE_MAX_CHANNELS 8   /**< Number of curve channels supported by the DGUS */
 
 /**
  * @brief SP Structure for realtime curve control
@@ -62,8 +73,10 @@ curve *dgus_curve_buffer_create(uint8_t num_curves, uint8_t datapoint_buffer_len
  * 
  * @param cur curve handle
  * @param channel_id channel id we want to send data to
+ * @return #DGUS_RETURN #DGUS_ERROR when every channel is initialised, #DGUS_NO_MEMORY if the data buffer
+ * could not be allocated. The channel is not added on error
  */
-void dgus_curve_init_channel(curve *cur, uint8_t channel_id);
+DGUS_RETURN dgus_curve_init_channel(curve *cur, uint8_t channel_id);
 
 /**
  * @brief Send the data we have aggregated in the curve instance
@@ -97,4 +110,103 @@ DGUS_RETURN dgus_curve_reset(curve *cur, uint8_t chan_id);
  * 
  * @param cur curve
  */
-void dgus_curve_destroy(curve *cur);
\ No newline at end of file
+void dgus_curve_destroy(curve *cur);
+
+/**
+ * @brief Create a lock-free multi-producer, single-consumer ingestion queue for @p cur
+ * Producers on any thread call dgus_curve_ingest_push(). A single flusher thread
+ * calls dgus_curve_ingest_flush() to batch the samples into curve frames.
+ * 
+ * @param cur curve handle the samples are flushed into
+ * @param capacity number of samples the queue can hold. Rounded up to a power of 2
+ * @return curve_ingest* Opaque reference to the queue, or NULL on allocation failure
+ */
+curve_ingest *dgus_curve_ingest_create(curve *cur, uint16_t capacity);
+
+/**
+ * @brief Queue a sample from a producer thread. Never blocks and never takes a lock
+ * 
+ * @param q queue handle
+ * @param chan_id channel id
+ * @param data data to append
+ * @param timestamp caller supplied timestamp of the sample, e.g. monotonic ms
+ * @return DGUS_RETURN #DGUS_CURVE_BUFFER_FULL if the queue is full and the sample was dropped
+ */
+DGUS_RETURN dgus_curve_ingest_push(curve_ingest *q, uint8_t chan_id, uint16_t data, uint32_t timestamp);
+
+/**
+ * @brief Drain the queue into the curve buffer and send it. Only one thread may flush at a time
+ * A frame is sent whenever a channel buffer fills, and once more for the remainder.
+ * 
+ * @param q queue handle
+ * @return DGUS_RETURN the first error, such as #DGUS_CURVE_CHANNEL_NOT_FOUND if a sample targeted an
+ * uninitialised channel. The rest of the queue is still drained
+ */
+DGUS_RETURN dgus_curve_ingest_flush(curve_ingest *q);
+
+/**
+ * @brief Timestamp of the last sample flushed for a channel
+ * 
+ * @param q queue handle
+ * @param chan_id channel id
+ * @return uint32_t timestamp passed to dgus_curve_ingest_push(), 0 if none yet
+ */
+uint32_t dgus_curve_ingest_timestamp(curve_ingest *q, uint8_t chan_id);
+
+/**
+ * @brief Destroy an ingestion queue. The curve itself is not destroyed
+ * 
+ * @param q queue handle
+ */
+void dgus_curve_ingest_destroy(curve_ingest *q);
+
+/**
+ * @brief Bytes of memory needed by a replay log for @p num_curves channels of @p window samples
+ * 
+ * @param num_curves How many channels are enabled on the curve
+ * @param window number of samples visible on screen per channel
+ * @return size_t size to pass to dgus_curve_log_attach()
+ */
+size_t dgus_curve_log_size(uint8_t num_curves, uint16_t window);
+
+/**
+ * @brief Attach a ring log of recently sent samples to a curve
+ * Every sample sent by dgus_curve_send_data() is recorded, keeping the last @p window per channel.
+ * If @p mem already holds a log with the same geometry it is reused, so a memory-mapped file
+ * keeps the history across restarts of the host as well as the display.
+ * 
+ * @param cur curve handle. Channels must be initialised first
+ * @param mem caller owned memory of at least dgus_curve_log_size() bytes, e.g. from dgus_curve_log_map_file()
+ * @param len size of @p mem
+ * @param window number of samples visible on screen per channel
+ * @return DGUS_RETURN #DGUS_ERROR if @p mem is too small
+ */
+DGUS_RETURN dgus_curve_log_attach(curve *cur, void *mem, size_t len, uint16_t window);
+
+/**
+ * @brief Re-upload the logged window of every channel after the display lost its curve memory
+ * Samples are packed back to back into as few full frames as the send buffer allows.
+ * 
+ * @param cur curve handle with a log attached
+ * @return DGUS_RETURN #DGUS_ERROR if no log is attached
+ */
+DGUS_RETURN dgus_curve_replay(curve *cur);
+
+#if CURVE_LOG_MMAP
+/**
+ * @brief Map (creating if needed) a file to back a curve replay log
+ * 
+ * @param path file to map
+ * @param len size of the mapping, see dgus_curve_log_size()
+ * @return void* mapped memory or NULL on failure
+ */
+void *dgus_curve_log_map_file(const char *path, size_t len);
+
+/**
+ * @brief Unmap a log mapped with dgus_curve_log_map_file()
+ * 
+ * @param mem mapped memory
+ * @param len size of the mapping
+ */
+void dgus_curve_log_unmap(void *mem, size_t len);
+#endif
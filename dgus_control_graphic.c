@@ -0,0 +1,154 @@
+/**
+ * @file dgus_control_graphic.c
+ * @author Barry Carter
+ * @date 01 Jan 2021
+ * @brief DGUS II LCD Basic graphic display lists
+ */
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "dgus.h"
+#include "dgus_control_graphic.h"
+#include "dgus_alloc.h"
+
+#define GRAPHIC_FRAME_WORDS ((SEND_BUFFER_SIZE - 2) / 2)   /**< VP words that fit one write frame */
+
+struct graphic {
+  uint16_t vp;
+  uint16_t capacity;            /**< words, header included */
+  uint16_t room;                /**< words allocated, capacity can be rebound up to this */
+  uint16_t used;                /**< header and packets, not the end marker */
+  uint16_t words[];             /**< the control's VP area: cmd, count, packets, end */
+};
+
+graphic *dgus_graphic_create(uint16_t vp, uint16_t words) {
+  if (words < GRAPHIC_HEADER_WORDS + 1)
+    return NULL;
+
+  graphic *g = dgus_calloc(1, sizeof(graphic) + words * sizeof(uint16_t));
+  if (!g)
+    return NULL;
+
+  g->vp = vp;
+  g->capacity = words;
+  g->room = words;
+  dgus_graphic_clear(g);
+  return g;
+}
+
+DGUS_RETURN dgus_graphic_rebind(graphic *g, uint16_t vp, uint16_t words) {
+  if (words < GRAPHIC_HEADER_WORDS + 1 || words > g->room)
+    return DGUS_GRAPHIC_FULL;
+
+  g->vp = vp;
+  g->capacity = words;
+  dgus_graphic_clear(g);
+  return DGUS_OK;
+}
+
+void dgus_graphic_destroy(graphic *g) {
+  dgus_free(g);
+}
+
+void dgus_graphic_clear(graphic *g) {
+  g->words[0] = GRAPHIC_NONE;
+  g->words[1] = 0;
+  g->used = GRAPHIC_HEADER_WORDS;
+}
+
+DGUS_RETURN dgus_graphic_append(graphic *g, uint16_t cmd, const uint16_t *packet, uint8_t len) {
+  if (g->words[1] && g->words[0] != cmd)
+    return DGUS_ERROR;
+  // keep a word for the end marker
+  if (g->used + len + 1 > g->capacity)
+    return DGUS_GRAPHIC_FULL;
+
+  memcpy(&g->words[g->used], packet, len * sizeof(uint16_t));
+  g->used += len;
+  g->words[0] = cmd;
+  g->words[1]++;
+  return DGUS_OK;
+}
+
+DGUS_RETURN dgus_graphic_pixel(graphic *g, uint16_t x, uint16_t y, uint16_t colour) {
+  uint16_t p[] = { x, y, colour };
+  return dgus_graphic_append(g, GRAPHIC_PIXEL, p, 3);
+}
+
+DGUS_RETURN dgus_graphic_line(graphic *g, uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1, uint16_t colour) {
+  uint16_t p[] = { colour, x0, y0, x1, y1 };
+  return dgus_graphic_append(g, GRAPHIC_LINE, p, 5);
+}
+
+DGUS_RETURN dgus_graphic_rect(graphic *g, uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1, uint16_t colour) {
+  uint16_t p[] = { x0, y0, x1, y1, colour };
+  return dgus_graphic_append(g, GRAPHIC_RECT, p, 5);
+}
+
+DGUS_RETURN dgus_graphic_fill_rect(graphic *g, uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1, uint16_t colour) {
+  uint16_t p[] = { x0, y0, x1, y1, colour };
+  return dgus_graphic_append(g, GRAPHIC_FILL_RECT, p, 5);
+}
+
+DGUS_RETURN dgus_graphic_circle(graphic *g, uint16_t x, uint16_t y, uint16_t radius, uint16_t colour) {
+  uint16_t p[] = { x, y, radius, colour };
+  return dgus_graphic_append(g, GRAPHIC_CIRCLE, p, 4);
+}
+
+const uint16_t *dgus_graphic_words(graphic *g, uint16_t *vp, uint16_t *used) {
+  g->words[g->used] = GRAPHIC_END;
+  *vp = g->vp;
+  *used = g->used + 1;
+  return g->words;
+}
+
+DGUS_RETURN dgus_graphic_write(uint16_t vp, const uint16_t *data, uint16_t words) {
+  DGUS_RETURN r = DGUS_OK;
+
+  while (words) {
+    uint8_t n = words > GRAPHIC_FRAME_WORDS ? GRAPHIC_FRAME_WORDS : words;
+    dgus_packet *d = dgus_packet_acquire();
+    if (!d)
+      return DGUS_PACKET_POOL_EMPTY;
+    buffer_u16(d, &vp, 1);
+    buffer_u16(d, (uint16_t *)data, n);
+    if (dgus_packet_send(DGUS_CMD_VAR_W, d) != DGUS_OK)
+      r = DGUS_TIMEOUT;
+    vp += n;
+    data += n;
+    words -= n;
+  }
+  return r;
+}
+
+DGUS_RETURN dgus_graphic_send(graphic **lists, uint8_t count) {
+  DGUS_RETURN r = DGUS_OK;
+  uint16_t vp, used;
+
+  // a list that fits one frame goes whole, header and all
+  for (uint8_t i = 0; i < count; i++) {
+    const uint16_t *w = dgus_graphic_words(lists[i], &vp, &used);
+    if (used <= GRAPHIC_FRAME_WORDS) {
+      if (dgus_graphic_write(vp, w, used) != DGUS_OK)
+        r = DGUS_TIMEOUT;
+    }
+    else {
+      // the panel redraws on every refresh, so hide the old list while its packets change
+      uint16_t hold = 0;
+      if (dgus_graphic_write(vp + 1, &hold, 1) != DGUS_OK)
+        r = DGUS_TIMEOUT;
+      if (dgus_graphic_write(vp + GRAPHIC_HEADER_WORDS, w + GRAPHIC_HEADER_WORDS, used - GRAPHIC_HEADER_WORDS) != DGUS_OK)
+        r = DGUS_TIMEOUT;
+    }
+  }
+
+  for (uint8_t i = 0; i < count; i++) {
+    const uint16_t *w = dgus_graphic_words(lists[i], &vp, &used);
+    if (used > GRAPHIC_FRAME_WORDS && dgus_graphic_write(vp, w, GRAPHIC_HEADER_WORDS) != DGUS_OK)
+      r = DGUS_TIMEOUT;
+  }
+
+  return r;
+}
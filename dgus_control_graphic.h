@@ -0,0 +1,171 @@
+#pragma once
+/**
+ * @file dgus_control_graphic.h
+ * @author Barry Carter
+ * @date 01 Jan 2021
+ * @brief DGUS II LCD Basic graphic display lists
+ */
+#include <stddef.h>
+#include <stdint.h>
+#include "dgus_reg.h"
+#include "dgus.h"
+
+/**
+ * @brief Opaque reference to a display list
+ */
+typedef struct graphic graphic;
+
+#define GRAPHIC_HEADER_WORDS 2      /**< command and packet count at the control VP */
+#define GRAPHIC_END          0xFF00 /**< ends the packets early */
+
+/**
+ * @brief Basic graphic commands. A control draws one kind of primitive
+ */
+enum graphic_cmd {
+  GRAPHIC_NONE      = 0x0000,
+  GRAPHIC_PIXEL     = 0x0001,       /**< x, y, colour */
+  GRAPHIC_RECT      = 0x0003,       /**< x0, y0, x1, y1, colour */
+  GRAPHIC_FILL_RECT = 0x0004,       /**< x0, y0, x1, y1, colour */
+  GRAPHIC_CIRCLE    = 0x0005,       /**< x, y, radius, colour */
+  GRAPHIC_LINE      = 0x000A,       /**< colour, x0, y0, x1, y1 */
+};
+
+/**
+ * @brief Create a display list for the basic graphic control at @p vp
+ * Primitives are encoded straight into the layout of the control's VP area, so sending
+ * is a copy of the list.
+ *
+ * @param vp VP of the basic graphic control
+ * @param words VP words the control owns, header included
+ * @return graphic* Opaque reference to the list, or NULL on allocation failure
+ */
+graphic *dgus_graphic_create(uint16_t vp, uint16_t words);
+
+/**
+ * @brief Destroy a display list
+ *
+ * @param g list
+ */
+void dgus_graphic_destroy(graphic *g);
+
+/**
+ * @brief Empty the list to build the next scene. Nothing is sent
+ *
+ * @param g list
+ */
+void dgus_graphic_clear(graphic *g);
+
+/**
+ * @brief Append a pixel
+ *
+ * @param g list
+ * @param x x
+ * @param y y
+ * @param colour RGB565
+ * @return DGUS_RETURN #DGUS_GRAPHIC_FULL, #DGUS_ERROR if the list holds another kind of primitive
+ */
+DGUS_RETURN dgus_graphic_pixel(graphic *g, uint16_t x, uint16_t y, uint16_t colour);
+
+/**
+ * @brief Append a line segment
+ *
+ * @param g list
+ * @param x0 start x
+ * @param y0 start y
+ * @param x1 end x
+ * @param y1 end y
+ * @param colour RGB565
+ * @return DGUS_RETURN as dgus_graphic_pixel()
+ */
+DGUS_RETURN dgus_graphic_line(graphic *g, uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1, uint16_t colour);
+
+/**
+ * @brief Append a rectangle outline
+ *
+ * @param g list
+ * @param x0 top left x
+ * @param y0 top left y
+ * @param x1 bottom right x
+ * @param y1 bottom right y
+ * @param colour RGB565
+ * @return DGUS_RETURN as dgus_graphic_pixel()
+ */
+DGUS_RETURN dgus_graphic_rect(graphic *g, uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1, uint16_t colour);
+
+/**
+ * @brief Append a filled rectangle
+ *
+ * @param g list
+ * @param x0 top left x
+ * @param y0 top left y
+ * @param x1 bottom right x
+ * @param y1 bottom right y
+ * @param colour RGB565
+ * @return DGUS_RETURN as dgus_graphic_pixel()
+ */
+DGUS_RETURN dgus_graphic_fill_rect(graphic *g, uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1, uint16_t colour);
+
+/**
+ * @brief Append a circle outline
+ *
+ * @param g list
+ * @param x centre x
+ * @param y centre y
+ * @param radius radius
+ * @param colour RGB565
+ * @return DGUS_RETURN as dgus_graphic_pixel()
+ */
+DGUS_RETURN dgus_graphic_circle(graphic *g, uint16_t x, uint16_t y, uint16_t radius, uint16_t colour);
+
+/**
+ * @brief Send a whole scene made of several lists in one burst, no round trip per primitive
+ * A list longer than one frame has its count zeroed first, then its packets go in full frames,
+ * then the headers of every list, so the panel never draws a list whose packets are only half written.
+ *
+ * @param lists display lists, one per basic graphic control
+ * @param count number of lists
+ * @return DGUS_RETURN #DGUS_TIMEOUT if any frame was not acknowledged
+ */
+DGUS_RETURN dgus_graphic_send(graphic **lists, uint8_t count);
+
+/* internal */
+/**
+ * @brief Append one encoded packet, for dgus_canvas
+ *
+ * @param g list
+ * @param cmd #graphic_cmd of the packet
+ * @param packet packet words
+ * @param len words in the packet
+ * @return DGUS_RETURN as dgus_graphic_pixel()
+ */
+DGUS_RETURN dgus_graphic_append(graphic *g, uint16_t cmd, const uint16_t *packet, uint8_t len);
+
+/**
+ * @brief Point an existing list at another control and empty it, reusing its memory, for dgus_canvas
+ *
+ * @param g list
+ * @param vp VP of the control
+ * @param words VP words the control owns, no more than the list was created with
+ * @return DGUS_RETURN #DGUS_GRAPHIC_FULL if @p words does not fit the list's memory
+ */
+DGUS_RETURN dgus_graphic_rebind(graphic *g, uint16_t vp, uint16_t words);
+
+/**
+ * @brief Write VP words in full frames
+ *
+ * @param vp first VP
+ * @param data words, host byte order
+ * @param words number of words
+ * @return DGUS_RETURN #DGUS_TIMEOUT if any frame was not acknowledged
+ */
+DGUS_RETURN dgus_graphic_write(uint16_t vp, const uint16_t *data, uint16_t words);
+
+/**
+ * @brief Encoded content of a list, header first, for dgus_canvas
+ *
+ * @param g list
+ * @param vp VP of the control
+ * @param used words in use, header and end marker included
+ * @return const uint16_t* the words
+ */
+const uint16_t *dgus_graphic_words(graphic *g, uint16_t *vp, uint16_t *used);
@@ -0,0 +1,196 @@
+/**
+ * @file dgus_control_sp.c
+ * @author Barry Carter
+ * @date 01 Jan 2021
+ * @brief DGUS II LCD Generic SP descriptor access
+ */
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "dgus.h"
+#include "dgus_control_sp.h"
+
+/* Field layouts. H = u16, L = u32 (high word first), B = u8, an optional count repeats the field.
+ * Bytes sit in wire order, so the first B of a pair is the high byte of its VP word.
+ */
+static const char *_sp_layouts[DGUS_SP_TYPE_COUNT] = {
+  [DGUS_SP_VAR_ICON]        = "H7B6",
+  [DGUS_SP_ANIMATION_ICON]  = "H9B8",
+  [DGUS_SP_SLIDER_DISPLAY]  = "H7B9",
+  [DGUS_SP_ARTISTIC_VAR]    = "H4B10",
+  [DGUS_SP_IMAGE_ANIMATION] = "H3B19",
+  [DGUS_SP_ICON_ROTATION]   = "H10B3",
+  [DGUS_SP_BIT_VAR_ICON]    = "H2B4H8",
+  [DGUS_SP_DATA_VAR]        = "H4B18",
+  [DGUS_SP_TEXT_DISPLAY]    = "H9B8",
+  [DGUS_SP_RTC_DIGITAL]     = "H4B18",
+  [DGUS_SP_RTC_ANALOGUE]    = "H4LHLHLB2",
+  [DGUS_SP_HEX_DATA]        = "H3B18",
+  [DGUS_SP_ROLL_TEXT]       = "HB4H5B6L",
+  [DGUS_SP_DATA_WINDOW]     = "HB6H3B2HB2H2",
+  [DGUS_SP_BASIC_GRAPHIC]   = "HB26",
+  [DGUS_SP_ZONE_ROLLING]    = "H6",
+  [DGUS_SP_QR_CODE]         = "H4B2",
+  [DGUS_SP_AREA_BRIGHTNESS] = "H5",
+  [DGUS_SP_REALTIME_CURVE]  = "B2H6B8",
+};
+
+/* Next field of a layout. Returns its repeat count, 0 at the end */
+static uint8_t _sp_next(const char **layout, char *kind) {
+  uint8_t count = 0;
+
+  if (**layout == '\0')
+    return 0;
+
+  *kind = *(*layout)++;
+  while (**layout >= '0' && **layout <= '9')
+    count = count * 10 + (*(*layout)++ - '0');
+
+  return count ? count : 1;
+}
+
+/* Bytes covered by a layout */
+static uint8_t _sp_bytes(const char *layout) {
+  uint8_t off = 0;
+  uint8_t count;
+  char kind;
+
+  while ((count = _sp_next(&layout, &kind))) {
+    off += count * (kind == 'L' ? 4 : kind == 'H' ? 2 : 1);
+  }
+  return off;
+}
+
+/* Wire words (host order per word) to the host struct */
+static void _sp_unpack(const char *layout, const uint16_t *words, uint8_t *out) {
+  uint8_t off = 0;
+  uint8_t count;
+  char kind;
+
+  while ((count = _sp_next(&layout, &kind))) {
+    for (; count; count--) {
+      if (kind == 'H') {
+        uint16_t v = words[off / 2];
+        memcpy(out + off, &v, 2);
+        off += 2;
+      }
+      else if (kind == 'L') {
+        uint32_t v = ((uint32_t)words[off / 2] << 16) | words[off / 2 + 1];
+        memcpy(out + off, &v, 4);
+        off += 4;
+      }
+      else {
+        uint16_t w = words[off / 2];
+        out[off] = (off & 1) ? (w & 0xFF) : (w >> 8);
+        off++;
+      }
+    }
+  }
+}
+
+/* Host struct to wire words (host order per word) */
+static void _sp_pack(const char *layout, const uint8_t *in, uint16_t *words) {
+  uint8_t off = 0;
+  uint8_t count;
+  char kind;
+
+  while ((count = _sp_next(&layout, &kind))) {
+    for (; count; count--) {
+      if (kind == 'H') {
+        memcpy(&words[off / 2], in + off, 2);
+        off += 2;
+      }
+      else if (kind == 'L') {
+        uint32_t v;
+        memcpy(&v, in + off, 4);
+        words[off / 2] = v >> 16;
+        words[off / 2 + 1] = v & 0xFFFF;
+        off += 4;
+      }
+      else {
+        uint16_t *w = &words[off / 2];
+        if (off & 1)
+          *w = (*w & 0xFF00) | in[off];
+        else
+          *w = (*w & 0x00FF) | ((uint16_t)in[off] << 8);
+        off++;
+      }
+    }
+  }
+}
+
+uint8_t dgus_sp_words(enum dgus_sp_type type) {
+  if (type >= DGUS_SP_TYPE_COUNT)
+    return 0;
+
+  return (_sp_bytes(_sp_layouts[type]) + 1) / 2;
+}
+
+static DGUS_RETURN _sp_init(dgus_sp *sp, uint16_t addr, enum dgus_sp_type type) {
+  uint8_t words = dgus_sp_words(type);
+  if (words == 0)
+    return DGUS_SP_TYPE_UNKNOWN;
+
+  memset(sp, 0, sizeof(dgus_sp));
+  sp->addr = addr;
+  sp->type = type;
+  sp->words = words;
+  return DGUS_OK;
+}
+
+DGUS_RETURN dgus_sp_read(dgus_sp *sp, uint16_t addr, enum dgus_sp_type type) {
+  DGUS_RETURN r = _sp_init(sp, addr, type);
+  if (r != DGUS_OK)
+    return r;
+
+  r = dgus_get_var(addr, sp->wire, sp->words);
+  if (r != DGUS_OK)
+    return r;
+
+  _sp_unpack(_sp_layouts[type], sp->wire, sp->data.raw);
+  return DGUS_OK;
+}
+
+DGUS_RETURN dgus_sp_bind(dgus_sp *sp, uint16_t addr, enum dgus_sp_type type, const void *data) {
+  DGUS_RETURN r = _sp_init(sp, addr, type);
+  if (r != DGUS_OK)
+    return r;
+
+  memcpy(sp->data.raw, data, _sp_bytes(_sp_layouts[type]));
+  _sp_pack(_sp_layouts[type], sp->data.raw, sp->wire);
+  return DGUS_OK;
+}
+
+DGUS_RETURN dgus_sp_write(dgus_sp *sp) {
+  uint16_t words[DGUS_SP_MAX_WORDS];
+  int first = -1, last = -1;
+
+  memcpy(words, sp->wire, sizeof(words));
+  _sp_pack(_sp_layouts[sp->type], sp->data.raw, words);
+
+  for (int i = 0; i < sp->words; i++) {
+    if (words[i] != sp->wire[i]) {
+      if (first < 0)
+        first = i;
+      last = i;
+    }
+  }
+
+  if (first < 0)
+    return DGUS_OK;
+
+  uint16_t addr = sp->addr + first;
+  dgus_packet *d = dgus_packet_acquire();
+  if (!d)
+    return DGUS_PACKET_POOL_EMPTY;
+  buffer_u16(d, &addr, 1);
+  buffer_u16(d, &words[first], last - first + 1);
+
+  DGUS_RETURN r = dgus_packet_send(DGUS_CMD_VAR_W, d);
+  if (r == DGUS_OK)
+    memcpy(&sp->wire[first], &words[first], (last - first + 1) * 2);
+
+  return r;
+}
@@ -0,0 +1,111 @@
+#pragma once
+/**
+ * @file dgus_control_sp.h
+ * @author Barry Carter
+ * @date 01 Jan 2021
+ * @brief DGUS II LCD Generic SP descriptor access
+ */
+#include <stddef.h>
+#include <stdint.h>
+#include "dgus_reg.h"
+#include "dgus.h"
+#include "dgus_control_text.h"
+#include "dgus_control_curve.h"
+
+#define DGUS_SP_MAX_WORDS 16   /**< Largest SP descriptor handled, in words */
+
+/**
+ * @brief Control types with a known SP descriptor layout
+ */
+enum dgus_sp_type {
+  DGUS_SP_VAR_ICON,
+  DGUS_SP_ANIMATION_ICON,
+  DGUS_SP_SLIDER_DISPLAY,
+  DGUS_SP_ARTISTIC_VAR,
+  DGUS_SP_IMAGE_ANIMATION,
+  DGUS_SP_ICON_ROTATION,
+  DGUS_SP_BIT_VAR_ICON,
+  DGUS_SP_DATA_VAR,            /**< string_unit is read in full, up to 11 bytes */
+  DGUS_SP_TEXT_DISPLAY,
+  DGUS_SP_RTC_DIGITAL,         /**< string_code is read in full, up to 16 bytes */
+  DGUS_SP_RTC_ANALOGUE,
+  DGUS_SP_HEX_DATA,            /**< string_code is read in full, up to 15 bytes */
+  DGUS_SP_ROLL_TEXT,
+  DGUS_SP_DATA_WINDOW,
+  DGUS_SP_BASIC_GRAPHIC,
+  DGUS_SP_ZONE_ROLLING,
+  DGUS_SP_QR_CODE,
+  DGUS_SP_AREA_BRIGHTNESS,
+  DGUS_SP_REALTIME_CURVE,
+  DGUS_SP_TYPE_COUNT
+};
+
+/**
+ * @brief A control descriptor mirrored on the host
+ * Modify the fields through @p data, then dgus_sp_write() sends only the changed words.
+ * Types with a trailing string (data_var, rtc_display_digital, hex_data) are reached through data.raw.
+ */
+typedef struct dgus_sp {
+  uint16_t addr;                        /**< SP address of the control */
+  uint8_t type;                         /**< #dgus_sp_type */
+  uint8_t words;                        /**< descriptor length in words */
+  uint16_t wire[DGUS_SP_MAX_WORDS];     /**< last known content on the display, one VP word each */
+  union {
+    uint8_t raw[DGUS_SP_MAX_WORDS * 2];
+    var_icon var_icon;
+    animation_icon animation_icon;
+    slider_display slider_display;
+    artistic_var artistic_var;
+    image_animation image_animation;
+    icon_rotation icon_rotation;
+    bit_var_icon bit_var_icon;
+    dgus_control_text_display text;
+    rtc_display_analogue rtc_analogue;
+    roll_text roll_text;
+    data_window data_window;
+    basic_graphic basic_graphic;
+    zone_rolling zone_rolling;
+    qr_code qr_code;
+    area_brightness area_brightness;
+    realtime_curve realtime_curve;
+  } data;                               /**< descriptor fields in host byte order */
+} dgus_sp;
+
+/**
+ * @brief Read a whole control descriptor in one frame
+ *
+ * @param sp descriptor to fill
+ * @param addr SP address of the control. SP must be enabled
+ * @param type control type
+ * @return Response such as #DGUS_TIMEOUT or #DGUS_SP_TYPE_UNKNOWN
+ */
+DGUS_RETURN dgus_sp_read(dgus_sp *sp, uint16_t addr, enum dgus_sp_type type);
+
+/**
+ * @brief Start a descriptor from known content without reading the display
+ * The next dgus_sp_write() compares against @p data rather than the display.
+ *
+ * @param sp descriptor to fill
+ * @param addr SP address of the control
+ * @param type control type
+ * @param data current descriptor content in host byte order, e.g. a var_icon
+ * @return #DGUS_OK or #DGUS_SP_TYPE_UNKNOWN
+ */
+DGUS_RETURN dgus_sp_bind(dgus_sp *sp, uint16_t addr, enum dgus_sp_type type, const void *data);
+
+/**
+ * @brief Write back the span between the first and last changed word in one frame
+ * Nothing is sent if no field changed.
+ *
+ * @param sp descriptor previously filled by dgus_sp_read() or dgus_sp_bind()
+ * @return Response such as #DGUS_TIMEOUT
+ */
+DGUS_RETURN dgus_sp_write(dgus_sp *sp);
+
+/**
+ * @brief Size of a control descriptor in words
+ *
+ * @param type control type
+ * @return uint8_t words, 0 for an unknown type
+ */
+uint8_t dgus_sp_words(enum dgus_sp_type type);
@@ -10,23 +10,128 @@
 #include <stdint.h>
 #include <stddef.h>
 #include <time.h> 
+#include <stdarg.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 #include "dgus.h"
 #include "dgus_control_text.h"
 
+#define TEXT_FRAME_BYTES ((SEND_BUFFER_SIZE - 2) & ~1)   /**< text per write frame, whole words so the next frame starts on a VP */
+
+#if TEXT_TRANSCODE_GBK
+/* dgus_text_gbk.c */
+extern const uint8_t dgus_gbk_page_slot[256];
+extern const uint8_t dgus_gbk_page_lo[];
+extern const uint8_t dgus_gbk_page_hi[];
+extern const uint16_t dgus_gbk_page_off[];
+extern const uint16_t dgus_gbk_codes[];
+#endif
+
 
 union eight_adapt {
   uint8_t u8[2];
   uint16_t u16;
 };
 
+typedef struct text_cache_entry_t {
+  uint16_t addr;
+  uint8_t len;                          /**< field length in bytes, 0 when unused */
+  uint8_t data[TEXT_CACHE_FIELD_LEN];   /**< last padded text written */
+} text_cache_entry; /**< Last known content of a text VAR */
+
+typedef struct text_encoding_entry_t {
+  uint16_t sp;
+  uint16_t vp;
+  uint8_t encode_mode;
+  uint8_t used;
+} text_encoding_entry; /**< Cached VP and encoding of a text SP */
+
+static text_cache_entry _text_cache[TEXT_CACHE_ENTRIES];
+static uint8_t _text_cache_next;        /**< round robin victim */
+static text_encoding_entry _text_encodings[TEXT_ENCODING_CACHE];
+static uint8_t _text_encodings_next;    /**< round robin victim */
+
+static text_cache_entry *_text_cache_find(uint16_t addr) {
+  for (int i = 0; i < TEXT_CACHE_ENTRIES; i++) {
+    if (_text_cache[i].len && _text_cache[i].addr == addr)
+      return &_text_cache[i];
+  }
+  return NULL;
+}
+
+/* Drop cache entries overlapping a raw write of len bytes at addr */
+static void _text_cache_overlap(uint16_t addr, uint8_t len) {
+  uint16_t end = addr + (len + 1) / 2;
+  for (int i = 0; i < TEXT_CACHE_ENTRIES; i++) {
+    text_cache_entry *e = &_text_cache[i];
+    if (e->len && e->addr < end && addr < e->addr + (e->len + 1) / 2)
+      e->len = 0;
+  }
+}
+
+static uint8_t *_text_frame_begin(dgus_packet **d, uint16_t addr, uint8_t *len);
+static DGUS_RETURN _text_frame_send(dgus_packet *d, uint16_t addr, uint8_t *text, size_t n, uint8_t len);
+
+static DGUS_RETURN _send_text_span(uint16_t addr, uint8_t *data, uint8_t len) {
+  if (len > SEND_BUFFER_SIZE - 2)
+    return DGUS_ERROR;
+
+  dgus_packet *d = dgus_packet_acquire();
+  if (!d)
+    return DGUS_PACKET_POOL_EMPTY;
+  buffer_u16(d, &addr, 1);
+  buffer_u8(d, data, len);
+  return dgus_packet_send(DGUS_CMD_VAR_W, d);
+}
+
+/* A span longer than a frame goes out as several, each a whole number of words */
+static DGUS_RETURN _send_text_spans(uint16_t addr, uint8_t *data, uint8_t len) {
+  while (len > TEXT_FRAME_BYTES) {
+    DGUS_RETURN r = _send_text_span(addr, data, TEXT_FRAME_BYTES);
+    if (r != DGUS_OK)
+      return r;
+    addr += TEXT_FRAME_BYTES / 2;
+    data += TEXT_FRAME_BYTES;
+    len -= TEXT_FRAME_BYTES;
+  }
+  return _send_text_span(addr, data, len);
+}
+
+/* Write n bytes of text padded with spaces to len, a frame at a time */
+static DGUS_RETURN _send_text_field(uint16_t addr, const char *text, size_t n, uint8_t len) {
+  uint8_t buf[TEXT_FRAME_BYTES];
+  uint8_t off = 0;
+
+  while (off < len) {
+    uint8_t k = len - off > TEXT_FRAME_BYTES ? TEXT_FRAME_BYTES : len - off;
+    for (uint8_t i = 0; i < k; i++)
+      buf[i] = off + i < n ? text[off + i] : ' ';
+
+    DGUS_RETURN r = _send_text_span(addr, buf, k);
+    if (r != DGUS_OK)
+      return r;
+    addr += k / 2;
+    off += k;
+  }
+  return DGUS_OK;
+}
+
+/* Formatting room in the first frame of a field */
+static uint8_t _text_room(uint8_t len) {
+  return len && len < TEXT_FRAME_BYTES ? len : TEXT_FRAME_BYTES;
+}
+
 /* Read the text from an address
  * Reads in 8 bit data format when using 0x02 GBK
  */
 DGUS_RETURN dgus_get_text(uint16_t addr, uint8_t *buf, uint8_t len) {
-  dgus_packet *d = dgus_packet_init(addr);
+  dgus_packet *d = dgus_packet_acquire();
+  if (!d)
+    return DGUS_PACKET_POOL_EMPTY;
   buffer_u16(d, &addr, 1);
   buffer_u8(d, &len, 1);
-  send_data(DGUS_CMD_VAR_R, d);
+  dgus_packet_send(DGUS_CMD_VAR_R, d);
   return _polling_read_16(buf, len);
 }
 
@@ -39,78 +144,432 @@ DGUS_RETURN dgus_set_text(uint16_t addr, char *text) {
 
 /* Set text and pad the remaining space with empty string */
 DGUS_RETURN dgus_set_text_padded(uint16_t addr, char *text, uint8_t len) {
-  dgus_packet *d = dgus_packet_init();
-  buffer_u16(d, &addr, 1);
+  size_t n = strlen(text);
+
+  if (len == 0)
+    len = n > 0xFF ? 0xFF : n;
+  if (n > len)
+    n = len;
+
+  // longer than a frame, copy it out a frame at a time
+  if (len > TEXT_FRAME_BYTES) {
+    _text_cache_overlap(addr, len);
+    return _send_text_field(addr, text, n, len);
+  }
+
+  dgus_packet *d;
+  uint8_t *o = _text_frame_begin(&d, addr, &len);
+  if (!o)
+    return DGUS_PACKET_POOL_EMPTY;
+  memcpy(o, text, n);
+
+  return _text_frame_send(d, addr, o, n, len);
+}
+
+/* Send only the changed word spans of a padded text field */
+DGUS_RETURN dgus_set_text_delta(uint16_t addr, char *text, uint8_t len) {
+  uint8_t field[TEXT_CACHE_FIELD_LEN];
+  size_t tlen = strlen(text);
+
   if (len == 0)
-    len = strlen(text);
-  buffer_u8(d, text, len);
-  // override the packet len to send the padding
-  dgus_packet_set_len(d, len);
+    len = tlen;
+  // too big to cache, fall back to a full write
+  if (len > TEXT_CACHE_FIELD_LEN)
+    return dgus_set_text_padded(addr, text, len);
+
+  if (tlen > len)
+    tlen = len;
+  memcpy(field, text, tlen);
+  memset(field + tlen, ' ', len - tlen);
+
+  text_cache_entry *e = _text_cache_find(addr);
+  if (!e || e->len != len) {
+    if (e)
+      e->len = 0;
+    _text_cache_overlap(addr, len);
 
-  return send_data(DGUS_CMD_VAR_W, d);
+    DGUS_RETURN r = _send_text_spans(addr, field, len);
+    if (r != DGUS_OK)
+      return r;
+
+    e = &_text_cache[_text_cache_next];
+    _text_cache_next = (_text_cache_next + 1) % TEXT_CACHE_ENTRIES;
+    e->addr = addr;
+    e->len = len;
+    memcpy(e->data, field, len);
+    return DGUS_OK;
+  }
+
+  uint8_t words = (len + 1) / 2;
+  uint8_t w = 0;
+  while (w < words) {
+    // find the next changed word
+    while (w < words && memcmp(&e->data[w * 2], &field[w * 2], w * 2 + 1 < len ? 2 : 1) == 0)
+      w++;
+    if (w == words)
+      break;
+
+    // extend the span while changes are closer than a frame's overhead
+    uint8_t start = w, end = w + 1, gap = 0;
+    for (w = end; w < words && gap <= TEXT_DELTA_MERGE_GAP; w++) {
+      if (memcmp(&e->data[w * 2], &field[w * 2], w * 2 + 1 < len ? 2 : 1) != 0) {
+        end = w + 1;
+        gap = 0;
+      }
+      else {
+        gap++;
+      }
+    }
+    w = end;
+
+    uint8_t off = start * 2;
+    uint8_t n = (end * 2 > len ? len : end * 2) - off;
+    DGUS_RETURN r = _send_text_spans(addr + start, &field[off], n);
+    if (r != DGUS_OK) {
+      // the display state is unknown now, resend everything next time
+      e->len = 0;
+      return r;
+    }
+    memcpy(&e->data[off], &field[off], n);
+  }
+
+  return DGUS_OK;
+}
+
+void dgus_text_cache_invalidate(uint16_t addr) {
+  text_cache_entry *e = _text_cache_find(addr);
+  if (e)
+    e->len = 0;
+}
+
+void dgus_text_cache_clear() {
+  memset(_text_cache, 0, sizeof(_text_cache));
+}
+
+/* Numeric formatting, straight into the frame */
+
+typedef struct text_fmt_t {
+  uint8_t width;
+  uint8_t zero;
+  uint8_t left;
+  uint8_t decimals;
+} text_fmt; /**< Parsed width, flags and precision of one field */
+
+static const char _digit_pairs[] =
+  "00010203040506070809"
+  "10111213141516171819"
+  "20212223242526272829"
+  "30313233343536373839"
+  "40414243444546474849"
+  "50515253545556575859"
+  "60616263646566676869"
+  "70717273747576777879"
+  "80818283848586878889"
+  "90919293949596979899";
+
+static const uint32_t _pow10[] = { 1, 10, 100, 1000, 10000, 100000, 1000000 };
+
+/* Write the decimal digits of v backwards ending at end, two at a time */
+static char *_u32_digits(uint32_t v, char *end) {
+  while (v >= 100) {
+    uint32_t q = v / 100;
+    end -= 2;
+    memcpy(end, &_digit_pairs[(v - q * 100) * 2], 2);
+    v = q;
+  }
+  if (v >= 10) {
+    end -= 2;
+    memcpy(end, &_digit_pairs[v * 2], 2);
+  }
+  else {
+    *--end = '0' + v;
+  }
+  return end;
+}
+
+static void _fmt_put(uint8_t *o, size_t room, size_t *n, char c) {
+  if (*n < room)
+    o[(*n)++] = c;
+}
+
+/* Lay out sign, body and width padding. Returns bytes written, truncated to room */
+static size_t _fmt_pad(uint8_t *o, size_t room, char sign, const char *body, size_t blen, text_fmt *f) {
+  size_t total = blen + (sign ? 1 : 0);
+  size_t pad = f->width > total ? f->width - total : 0;
+  size_t n = 0;
+
+  if (!f->left && !f->zero)
+    for (; pad; pad--) _fmt_put(o, room, &n, ' ');
+  if (sign)
+    _fmt_put(o, room, &n, sign);
+  if (!f->left && f->zero)
+    for (; pad; pad--) _fmt_put(o, room, &n, '0');
+  for (size_t i = 0; i < blen; i++)
+    _fmt_put(o, room, &n, body[i]);
+  for (; pad; pad--) _fmt_put(o, room, &n, ' ');
+
+  return n;
+}
+
+/* Fixed point: value is scaled by 10^decimals */
+static size_t _fmt_fixed(uint8_t *o, size_t room, int32_t value, text_fmt *f) {
+  char buf[16];
+  char *end = buf + sizeof(buf);
+  uint32_t mag = value < 0 ? 0u - (uint32_t)value : (uint32_t)value;
+  char *p = _u32_digits(mag, end);
+
+  if (f->decimals) {
+    // make sure there is at least one digit before the point
+    while (end - p <= f->decimals)
+      *--p = '0';
+    // open a gap for the point
+    memmove(p - 1, p, (end - p) - f->decimals);
+    p--;
+    *(end - f->decimals - 1) = '.';
+  }
+
+  return _fmt_pad(o, room, value < 0 ? '-' : 0, p, end - p, f);
+}
+
+static size_t _fmt_float(uint8_t *o, size_t room, float value, text_fmt *f) {
+  if (value != value)
+    return _fmt_pad(o, room, 0, "nan", 3, f);
+
+  if (f->decimals > 6)
+    f->decimals = 6;
+
+  float scaled = value * _pow10[f->decimals];
+  if (scaled > 2147483647.0f)
+    scaled = 2147483647.0f;
+  if (scaled < -2147483647.0f)
+    scaled = -2147483647.0f;
+
+  return _fmt_fixed(o, room, (int32_t)(scaled + (scaled < 0 ? -0.5f : 0.5f)), f);
+}
+
+static size_t _fmt_hex(uint8_t *o, size_t room, uint32_t v, text_fmt *f) {
+  static const char hex[] = "0123456789abcdef";
+  char buf[8];
+  char *p = buf + sizeof(buf);
+
+  do {
+    *--p = hex[v & 0xF];
+    v >>= 4;
+  } while (v);
+
+  return _fmt_pad(o, room, 0, p, buf + sizeof(buf) - p, f);
+}
+
+static void _fmt_from_width(text_fmt *f, uint8_t width, uint8_t decimals) {
+  f->width = width & 0x3F;
+  f->zero = (width & TEXT_FMT_ZERO) != 0;
+  f->left = (width & TEXT_FMT_LEFT) != 0;
+  f->decimals = decimals;
+}
+
+/* Start a text frame and hand back room for the text in place */
+static uint8_t *_text_frame_begin(dgus_packet **d, uint16_t addr, uint8_t *len) {
+  *d = dgus_packet_acquire();
+  if (!*d)
+    return NULL;
+  buffer_u16(*d, &addr, 1);
+  return dgus_packet_reserve(*d, SEND_BUFFER_SIZE - 2);
+}
+
+/* Pad the text written in place to len and send it. Padding past the first frame follows in more */
+static DGUS_RETURN _text_frame_send(dgus_packet *d, uint16_t addr, uint8_t *text, size_t n, uint8_t len) {
+  if (len < n)
+    len = n;
+  uint8_t first = len > TEXT_FRAME_BYTES ? TEXT_FRAME_BYTES : len;
+  if (first > n)
+    memset(text + n, ' ', first - n);
+
+  dgus_packet_set_len(d, 2 + first);
+  _text_cache_overlap(addr, len);
+  DGUS_RETURN r = dgus_packet_send(DGUS_CMD_VAR_W, d);
+  if (r != DGUS_OK || first == len)
+    return r;
+
+  return _send_text_field(addr + first / 2, NULL, 0, len - first);
+}
+
+DGUS_RETURN dgus_set_text_int(uint16_t addr, int32_t value, uint8_t width, uint8_t len) {
+  return dgus_set_text_fixed(addr, value, 0, width, len);
+}
+
+DGUS_RETURN dgus_set_text_fixed(uint16_t addr, int32_t value, uint8_t decimals, uint8_t width, uint8_t len) {
+  text_fmt f;
+  dgus_packet *d;
+  uint8_t *o = _text_frame_begin(&d, addr, &len);
+  if (!o)
+    return DGUS_PACKET_POOL_EMPTY;
+
+  if (decimals > 9)
+    decimals = 9;
+  _fmt_from_width(&f, width, decimals);
+  size_t n = _fmt_fixed(o, _text_room(len), value, &f);
+  return _text_frame_send(d, addr, o, n, len);
+}
+
+DGUS_RETURN dgus_set_text_float(uint16_t addr, float value, uint8_t decimals, uint8_t width, uint8_t len) {
+  text_fmt f;
+  dgus_packet *d;
+  uint8_t *o = _text_frame_begin(&d, addr, &len);
+  if (!o)
+    return DGUS_PACKET_POOL_EMPTY;
+
+  _fmt_from_width(&f, width, decimals);
+  size_t n = _fmt_float(o, _text_room(len), value, &f);
+  return _text_frame_send(d, addr, o, n, len);
+}
+
+DGUS_RETURN dgus_set_text_format(uint16_t addr, uint8_t len, const char *tmpl, ...) {
+  dgus_packet *d;
+  uint8_t *o = _text_frame_begin(&d, addr, &len);
+  if (!o)
+    return DGUS_PACKET_POOL_EMPTY;
+  size_t room = _text_room(len);
+  size_t n = 0;
+  va_list ap;
+
+  va_start(ap, tmpl);
+  for (const char *t = tmpl; *t && n < room; t++) {
+    if (*t != '%' || t[1] == '\0') {
+      o[n++] = *t;
+      continue;
+    }
+
+    text_fmt f = { 0 };
+    int precision = -1;
+    t++;
+    for (; *t == '-' || *t == '0'; t++) {
+      if (*t == '-') f.left = 1;
+      else f.zero = 1;
+    }
+    for (; *t >= '0' && *t <= '9'; t++)
+      f.width = f.width * 10 + (*t - '0');
+    if (*t == '.') {
+      precision = 0;
+      for (t++; *t >= '0' && *t <= '9'; t++)
+        precision = precision * 10 + (*t - '0');
+    }
+
+    switch (*t) {
+    case 'd':
+    case 'i':
+      n += _fmt_fixed(o + n, room - n, va_arg(ap, int), &f);
+      break;
+    case 'u': {
+      unsigned int v = va_arg(ap, unsigned int);
+      char buf[12];
+      char *p = _u32_digits(v, buf + sizeof(buf));
+      n += _fmt_pad(o + n, room - n, 0, p, buf + sizeof(buf) - p, &f);
+      break;
+    }
+    case 'x':
+      n += _fmt_hex(o + n, room - n, va_arg(ap, unsigned int), &f);
+      break;
+    case 'f':
+      f.decimals = precision < 0 ? 2 : precision;
+      n += _fmt_float(o + n, room - n, (float)va_arg(ap, double), &f);
+      break;
+    case 'c': {
+      char c = (char)va_arg(ap, int);
+      n += _fmt_pad(o + n, room - n, 0, &c, 1, &f);
+      break;
+    }
+    case 's': {
+      const char *str = va_arg(ap, const char *);
+      size_t sl = strlen(str);
+      if (precision >= 0 && sl > (size_t)precision)
+        sl = precision;
+      f.zero = 0;
+      n += _fmt_pad(o + n, room - n, 0, str, sl, &f);
+      break;
+    }
+    case '%':
+      o[n++] = '%';
+      break;
+    default:
+      // unknown conversion, emit it as is
+      o[n++] = '%';
+      if (*t && n < room)
+        o[n++] = *t;
+      if (!*t)
+        t--;
+      break;
+    }
+  }
+  va_end(ap);
+
+  return _text_frame_send(d, addr, o, n, len);
 }
 
 /* Only work when using SP enabled. addr is SP address */
 
 DGUS_RETURN dgus_get_text_vp(uint16_t addr, uint16_t *vp) {
-  return dgus_get_var(addr + offsetof(dgus_control_text_display, vp), vp, 1);
+  return dgus_get_var(addr + member_word(dgus_control_text_display, vp), vp, 1);
 }
 
 DGUS_RETURN dgus_set_text_vp(uint16_t addr, uint16_t vp) {
-  return dgus_set_var(addr + offsetof(dgus_control_text_display, vp), vp);
+  return dgus_set_var(addr + member_word(dgus_control_text_display, vp), vp);
 }
 
 DGUS_RETURN dgus_get_text_pos(uint16_t addr, dgus_control_position *pos) {
   uint16_t d[sizeof(dgus_control_position)/2];
   memcpy(d, pos, sizeof(dgus_control_position));
-  return dgus_get_var(addr + offsetof(dgus_control_text_display, pos), d, 2);
+  return dgus_get_var(addr + member_word(dgus_control_text_display, pos), d, 2);
 }
 
 DGUS_RETURN dgus_set_text_pos(uint16_t addr, dgus_control_position pos) {
   uint16_t npos[sizeof(dgus_control_position)];
   memcpy(npos, &npos, sizeof(dgus_control_position));
-  uint16_t newaddr = addr + offsetof(dgus_control_text_display, pos);
-  dgus_packet *d = dgus_packet_init();
+  uint16_t newaddr = addr + member_word(dgus_control_text_display, pos);
+  dgus_packet *d = dgus_packet_acquire();
+  if (!d)
+    return DGUS_PACKET_POOL_EMPTY;
   buffer_u16(d, &newaddr, 1);
   buffer_u16(d, npos, member_size(dgus_control_text_display, pos) / 2);
-  return send_data(DGUS_CMD_VAR_W, d);
+  return dgus_packet_send(DGUS_CMD_VAR_W, d);
 }
 
 DGUS_RETURN dgus_get_text_colour(uint16_t addr, uint16_t *colour) {
-  return dgus_get_var(addr + offsetof(dgus_control_text_display, colour), colour, 1);
+  return dgus_get_var(addr + member_word(dgus_control_text_display, colour), colour, 1);
 }
 
 DGUS_RETURN dgus_set_text_colour(uint16_t addr, uint16_t colour) {
-  return dgus_set_var(addr + offsetof(dgus_control_text_display, colour), colour);
+  return dgus_set_var(addr + member_word(dgus_control_text_display, colour), colour);
 }
 
 DGUS_RETURN dgus_get_text_bounding_size(uint16_t addr, dgus_control_size *size) {
   uint16_t sz[sizeof(dgus_control_size)/2];
   memcpy(sz, size, sizeof(dgus_control_size)/2);
-  return dgus_get_var(addr + offsetof(dgus_control_text_display, size), sz, member_size(dgus_control_text_display, size) / 2 );
+  return dgus_get_var(addr + member_word(dgus_control_text_display, size), sz, member_size(dgus_control_text_display, size) / 2 );
 }
 
 DGUS_RETURN dgus_set_text_bounding_size(uint16_t addr, dgus_control_size size) {
   uint16_t sz[sizeof(dgus_control_size)/2];
   memcpy(sz, &size, sizeof(dgus_control_size));
-  uint16_t newaddr = addr + offsetof(dgus_control_text_display, size);
-  dgus_packet *d = dgus_packet_init();
+  uint16_t newaddr = addr + member_word(dgus_control_text_display, size);
+  dgus_packet *d = dgus_packet_acquire();
+  if (!d)
+    return DGUS_PACKET_POOL_EMPTY;
   buffer_u16(d, &newaddr, 1);
   buffer_u16(d, sz, member_size(dgus_control_text_display, size) / 2);
-  return send_data(DGUS_CMD_VAR_W, d);
+  return dgus_packet_send(DGUS_CMD_VAR_W, d);
 }
 
 DGUS_RETURN dgus_get_text_len(uint16_t addr, uint16_t *len) {
-  return dgus_get_var(addr + offsetof(dgus_control_text_display, text_len), len, 1);
+  return dgus_get_var(addr + member_word(dgus_control_text_display, text_len), len, 1);
 }
 
 DGUS_RETURN dgus_set_text_len(uint16_t addr, uint16_t len) {
-  return dgus_set_var(addr + offsetof(dgus_control_text_display, text_len), len);
+  return dgus_set_var(addr + member_word(dgus_control_text_display, text_len), len);
 }
 
 DGUS_RETURN dgus_get_text_fonts(uint16_t addr, uint8_t *font0, uint8_t *font1) {
   uint8_t fonts[2];
-  DGUS_RETURN r = dgus_get_var(addr + offsetof(dgus_control_text_display, font_0_id), (uint16_t *)&fonts, 1);
+  DGUS_RETURN r = dgus_get_var(addr + member_word(dgus_control_text_display, font_0_id), (uint16_t *)&fonts, 1);
   if (r != DGUS_OK) return r;
 
   *font0 = fonts[0];
@@ -120,12 +579,12 @@ DGUS_RETURN dgus_get_text_fonts(uint16_t addr, uint8_t *font0, uint8_t *font1) {
 
 DGUS_RETURN dgus_set_text_fonts(uint16_t addr, uint8_t font0, uint8_t font1) {
   union eight_adapt f; f.u8[0] = font0; f.u8[1] = font1;
-  return dgus_set_var(addr + offsetof(dgus_control_text_display, font_0_id), f.u16);
+  return dgus_set_var(addr + member_word(dgus_control_text_display, font_0_id), f.u16);
 }
 
 DGUS_RETURN dgus_get_text_font_dots(uint16_t addr, uint8_t *fontx_dots, uint8_t *fonty_dots) {
   uint8_t fonts[2];
-  DGUS_RETURN r = dgus_get_var(addr + offsetof(dgus_control_text_display, font_x_dots), (uint16_t *)&fonts, 1);
+  DGUS_RETURN r = dgus_get_var(addr + member_word(dgus_control_text_display, font_x_dots), (uint16_t *)&fonts, 1);
   if (r != DGUS_OK) return r;
 
   *fontx_dots = fonts[0];
@@ -135,12 +594,12 @@ DGUS_RETURN dgus_get_text_font_dots(uint16_t addr, uint8_t *fontx_dots, uint8_t
 
 DGUS_RETURN dgus_set_text_font_dots(uint16_t addr, uint8_t fontx_dots, uint8_t fonty_dots) {
   union eight_adapt f; f.u8[0] = fontx_dots; f.u8[1] = fonty_dots;
-  return dgus_set_var(addr + offsetof(dgus_control_text_display, font_x_dots), f.u16);
+  return dgus_set_var(addr + member_word(dgus_control_text_display, font_x_dots), f.u16);
 }
 
 DGUS_RETURN dgus_get_text_encode_mode_distance(uint16_t addr, uint8_t *encode_mode, uint8_t *vert_distance, uint8_t *horiz_distance) {
   uint8_t fonts[2];
-  DGUS_RETURN r = dgus_get_var(addr + offsetof(dgus_control_text_display, encode_mode), (uint16_t *)&fonts, 1);
+  DGUS_RETURN r = dgus_get_var(addr + member_word(dgus_control_text_display, encode_mode), (uint16_t *)&fonts, 1);
   if (r != DGUS_OK) return r;
 
   *encode_mode = fonts[0];
@@ -153,5 +612,242 @@ DGUS_RETURN dgus_set_text_encode_mode_distance(uint16_t addr, uint8_t encode_mod
   union eight_adapt f;
   f.u8[0] = encode_mode;
   f.u8[1] = vert_distance;
-  return dgus_set_var(addr + offsetof(dgus_control_text_display, encode_mode), f.u16);  
+  return dgus_set_var(addr + member_word(dgus_control_text_display, encode_mode), f.u16);  
+}
+
+/* UTF-8 transcoding */
+
+/* Length of the leading run of ASCII bytes */
+static size_t _ascii_run(const uint8_t *s, size_t n) {
+  size_t i = 0;
+#if defined(__SSE2__)
+  for (; i + 16 <= n; i += 16) {
+    int m = _mm_movemask_epi8(_mm_loadu_si128((const __m128i *)(s + i)));
+    if (m)
+      return i + __builtin_ctz(m);
+  }
+#else
+  for (; i + 8 <= n; i += 8) {
+    uint64_t w;
+    memcpy(&w, s + i, 8);
+    if (w & 0x8080808080808080ULL)
+      break;
+  }
+#endif
+  while (i < n && s[i] < 0x80)
+    i++;
+  return i;
+}
+
+/* ASCII to UTF-16BE */
+static void _widen_be(const uint8_t *s, uint8_t *o, size_t n) {
+  size_t i = 0;
+#if defined(__SSE2__)
+  const __m128i z = _mm_setzero_si128();
+  for (; i + 16 <= n; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+    _mm_storeu_si128((__m128i *)(o + i * 2), _mm_unpacklo_epi8(z, v));
+    _mm_storeu_si128((__m128i *)(o + i * 2 + 16), _mm_unpackhi_epi8(z, v));
+  }
+#endif
+  for (; i < n; i++) {
+    o[i * 2] = 0;
+    o[i * 2 + 1] = s[i];
+  }
+}
+
+/* Decode one multi byte UTF-8 sequence. Returns bytes consumed, *cp is 0xFFFD when malformed */
+static size_t _utf8_decode(const uint8_t *s, size_t n, uint32_t *cp) {
+  uint8_t c = s[0];
+  size_t len;
+  uint32_t min;
+
+  if (c >= 0xC2 && c <= 0xDF)      { len = 2; *cp = c & 0x1F; min = 0x80; }
+  else if (c >= 0xE0 && c <= 0xEF) { len = 3; *cp = c & 0x0F; min = 0x800; }
+  else if (c >= 0xF0 && c <= 0xF4) { len = 4; *cp = c & 0x07; min = 0x10000; }
+  else {
+    *cp = 0xFFFD;
+    return 1;
+  }
+
+  if (len > n) {
+    *cp = 0xFFFD;
+    return n;
+  }
+  for (size_t i = 1; i < len; i++) {
+    if ((s[i] & 0xC0) != 0x80) {
+      *cp = 0xFFFD;
+      return i;
+    }
+    *cp = (*cp << 6) | (s[i] & 0x3F);
+  }
+  if (*cp < min || (*cp >= 0xD800 && *cp < 0xE000))
+    *cp = 0xFFFD;
+  return len;
+}
+
+#if TEXT_TRANSCODE_GBK
+static uint16_t _gbk_lookup(uint32_t cp) {
+  if (cp > 0xFFFF)
+    return 0;
+
+  uint8_t slot = dgus_gbk_page_slot[cp >> 8];
+  uint8_t lo = cp & 0xFF;
+  if (slot == 0xFF || lo < dgus_gbk_page_lo[slot] || lo > dgus_gbk_page_hi[slot])
+    return 0;
+
+  return dgus_gbk_codes[dgus_gbk_page_off[slot] + lo - dgus_gbk_page_lo[slot]];
+}
+#endif
+
+/* Encode one non ASCII codepoint. Returns bytes written, 0 when it does not fit */
+static size_t _encode_cp(uint8_t encode_mode, uint32_t cp, uint8_t *o, size_t room) {
+  uint16_t code = 0;
+
+  switch (encode_mode) {
+  case TEXT_ENCODE_UNICODE:
+    code = cp > 0xFFFF ? '?' : cp;
+    if (room < 2)
+      return 0;
+    o[0] = code >> 8;
+    o[1] = code & 0xFF;
+    return 2;
+#if TEXT_TRANSCODE_GBK
+  case TEXT_ENCODE_GB2312:
+  case TEXT_ENCODE_GBK:
+    code = _gbk_lookup(cp);
+    // GB2312 is the EUC-CN area of GBK, both bytes 0xA1 or above
+    if (encode_mode == TEXT_ENCODE_GB2312 && ((code >> 8) < 0xA1 || (code & 0xFF) < 0xA1))
+      code = 0;
+    if (code) {
+      if (room < 2)
+        return 0;
+      o[0] = code >> 8;
+      o[1] = code & 0xFF;
+      return 2;
+    }
+    break;
+#endif
+  default:
+    // 8 bit, Latin-1
+    if (cp <= 0xFF)
+      code = cp;
+    break;
+  }
+
+  if (room < 1)
+    return 0;
+  o[0] = code ? code : '?';
+  return 1;
+}
+
+static int _encoding_supported(uint8_t encode_mode) {
+  switch (encode_mode) {
+  case TEXT_ENCODE_8BIT:
+  case TEXT_ENCODE_UNICODE:
+    return 1;
+#if TEXT_TRANSCODE_GBK
+  case TEXT_ENCODE_GB2312:
+  case TEXT_ENCODE_GBK:
+    return 1;
+#endif
+  default:
+    return 0;
+  }
+}
+
+size_t dgus_text_transcode(uint8_t encode_mode, const char *text, uint8_t *out, size_t out_len) {
+  const uint8_t *s = (const uint8_t *)text;
+  size_t n = strlen(text);
+  size_t wide = encode_mode == TEXT_ENCODE_UNICODE ? 2 : 1;
+  size_t o = 0;
+
+  while (n) {
+    size_t run = _ascii_run(s, n);
+    if (run * wide > out_len - o)
+      run = (out_len - o) / wide;
+
+    if (wide == 2)
+      _widen_be(s, out + o, run);
+    else
+      memcpy(out + o, s, run);
+    o += run * wide;
+    s += run;
+    n -= run;
+
+    if (n == 0 || s[0] < 0x80)
+      break; // out of room inside an ASCII run
+
+    uint32_t cp;
+    size_t used = _utf8_decode(s, n, &cp);
+    size_t w = _encode_cp(encode_mode, cp, out + o, out_len - o);
+    if (w == 0)
+      break;
+    o += w;
+    s += used;
+    n -= used;
+  }
+
+  return o;
+}
+
+void dgus_text_set_encoding(uint16_t sp, uint16_t vp, uint8_t encode_mode) {
+  text_encoding_entry *e = NULL;
+
+  for (int i = 0; i < TEXT_ENCODING_CACHE; i++) {
+    if (_text_encodings[i].used && _text_encodings[i].sp == sp)
+      e = &_text_encodings[i];
+  }
+  if (!e) {
+    e = &_text_encodings[_text_encodings_next];
+    _text_encodings_next = (_text_encodings_next + 1) % TEXT_ENCODING_CACHE;
+  }
+
+  e->sp = sp;
+  e->vp = vp;
+  e->encode_mode = encode_mode;
+  e->used = 1;
+}
+
+static text_encoding_entry *_text_encoding(uint16_t sp) {
+  for (int i = 0; i < TEXT_ENCODING_CACHE; i++) {
+    if (_text_encodings[i].used && _text_encodings[i].sp == sp)
+      return &_text_encodings[i];
+  }
+  return NULL;
+}
+
+DGUS_RETURN dgus_set_text_utf8(uint16_t sp, const char *text, uint8_t len) {
+  text_encoding_entry *e = _text_encoding(sp);
+
+  if (!e) {
+    // one read covering the vp through the encode mode word
+    uint16_t words[member_word(dgus_control_text_display, encode_mode) + 1];
+    DGUS_RETURN r = dgus_get_var(sp, words, sizeof(words) / 2);
+    if (r != DGUS_OK)
+      return r;
+
+    // encode_mode is the first byte on the wire, the high byte of its word
+    dgus_text_set_encoding(sp, words[0], words[member_word(dgus_control_text_display, encode_mode)] >> 8);
+    e = _text_encoding(sp);
+  }
+
+  if (!_encoding_supported(e->encode_mode))
+    return DGUS_TEXT_ENCODING_UNSUPPORTED;
+
+  uint8_t buf[SEND_BUFFER_SIZE - 2];
+  if (len > sizeof(buf))
+    len = sizeof(buf);
+
+  size_t n = dgus_text_transcode(e->encode_mode, text, buf, len ? len : sizeof(buf));
+  if (len == 0)
+    len = n;
+
+  // pad with spaces, a word each in UNICODE
+  for (size_t i = n; i < len; i++) {
+    buf[i] = (e->encode_mode == TEXT_ENCODE_UNICODE && (i & 1) == 0) ? 0x00 : ' ';
+  }
+
+  _text_cache_overlap(e->vp, len);
+  return _send_text_span(e->vp, buf, len);
 }
@@ -27,6 +27,16 @@ typedef struct __attribute__((packed)) dgus_control_text_display {
   uint8_t reserved0;
 } dgus_control_text_display; /**< Register layout for the text SP register */
 
+#define TEXT_ENCODE_8BIT     0x00   /**< Single byte, ASCII and Latin-1 */
+#define TEXT_ENCODE_GB2312   0x01   /**< GB2312 */
+#define TEXT_ENCODE_GBK      0x02   /**< GBK */
+#define TEXT_ENCODE_BIG5     0x03   /**< BIG5 */
+#define TEXT_ENCODE_SJIS     0x04   /**< Shift JIS */
+#define TEXT_ENCODE_UNICODE  0x05   /**< UTF-16BE */
+
+#define TEXT_FMT_ZERO        0x80   /**< OR into a width to pad numbers with leading zeros */
+#define TEXT_FMT_LEFT        0x40   /**< OR into a width to left align numbers */
+
 /**
  * @brief Read from VAR address as text
  * Reads in 8 bit data format when using 0x02 GBK
@@ -59,6 +69,116 @@ DGUS_RETURN dgus_set_text(uint16_t addr, char *text);
  */
 DGUS_RETURN dgus_set_text_padded(uint16_t addr, char *text, uint8_t len);
 
+/**
+ * @brief Write padded text to the address VAR, sending only the words that changed since the last write
+ * The last text written to @p addr is cached. Changed words are grouped into spans, and spans
+ * separated by only a few unchanged words are merged. Each span costs one frame.
+ * The first write to an address, or a write of a different field length, sends the whole field.
+ * Spans longer than one frame are split across frames.
+ * 
+ * @param addr address to write to
+ * @param text text to send. Must be null terminated
+ * @param len field length. Text is padded with spaces up to this length. 0 for strlen(text)
+ * @return Response such as #DGUS_TIMEOUT
+ */
+DGUS_RETURN dgus_set_text_delta(uint16_t addr, char *text, uint8_t len);
+
+/**
+ * @brief Forget the cached text for an address, e.g. after the display was reset
+ * The next dgus_set_text_delta() to the address will send the whole field.
+ * 
+ * @param addr address of the text VAR
+ */
+void dgus_text_cache_invalidate(uint16_t addr);
+
+/**
+ * @brief Forget all cached text
+ */
+void dgus_text_cache_clear();
+
+/**
+ * @brief Format an integer straight into the outgoing frame, without printf
+ * 
+ * @param addr address to write to
+ * @param value value to display
+ * @param width minimum width, right aligned with spaces. OR in #TEXT_FMT_ZERO or #TEXT_FMT_LEFT
+ * @param len field length, padded with spaces. 0 to send just the number
+ * @return Response such as #DGUS_TIMEOUT
+ */
+DGUS_RETURN dgus_set_text_int(uint16_t addr, int32_t value, uint8_t width, uint8_t len);
+
+/**
+ * @brief Format a fixed point number straight into the outgoing frame
+ * e.g. value 2605, decimals 1 displays "260.5"
+ * 
+ * @param addr address to write to
+ * @param value value scaled by 10^decimals
+ * @param decimals digits after the decimal point
+ * @param width minimum width including sign and point. OR in #TEXT_FMT_ZERO or #TEXT_FMT_LEFT
+ * @param len field length, padded with spaces. 0 to send just the number
+ * @return Response such as #DGUS_TIMEOUT
+ */
+DGUS_RETURN dgus_set_text_fixed(uint16_t addr, int32_t value, uint8_t decimals, uint8_t width, uint8_t len);
+
+/**
+ * @brief Format a float straight into the outgoing frame, rounded to @p decimals
+ * @note values are converted to fixed point, so |value| * 10^decimals must fit in 32 bits
+ * 
+ * @param addr address to write to
+ * @param value value to display
+ * @param decimals digits after the decimal point, up to 6
+ * @param width minimum width including sign and point. OR in #TEXT_FMT_ZERO or #TEXT_FMT_LEFT
+ * @param len field length, padded with spaces. 0 to send just the number
+ * @return Response such as #DGUS_TIMEOUT
+ */
+DGUS_RETURN dgus_set_text_float(uint16_t addr, float value, uint8_t decimals, uint8_t width, uint8_t len);
+
+/**
+ * @brief Build text from a template straight into the outgoing frame, without printf
+ * Supports %d %u %x %c %s %f and %%, with optional -, 0, width and .precision,
+ * e.g. "%d/%dc" or "%02d:%02d / %02d:%02d". %f takes a double and defaults to 2 decimals.
+ * 
+ * @param addr address to write to
+ * @param len field length, padded with spaces. 0 to send just the text
+ * @param tmpl template
+ * @param ... values for the template
+ * @return Response such as #DGUS_TIMEOUT
+ */
+DGUS_RETURN dgus_set_text_format(uint16_t addr, uint8_t len, const char *tmpl, ...);
+
+/**
+ * @brief Transcode a UTF-8 string into a text control encoding
+ * ASCII runs are copied (or widened for UNICODE) in bulk. Characters with no mapping become '?'.
+ * A character is never split at the end of @p out.
+ * 
+ * @param encode_mode one of #TEXT_ENCODE_8BIT, #TEXT_ENCODE_GB2312, #TEXT_ENCODE_GBK, #TEXT_ENCODE_UNICODE
+ * @param text UTF-8 text. Must be null terminated
+ * @param out output buffer
+ * @param out_len size of @p out
+ * @return size_t bytes written to @p out
+ */
+size_t dgus_text_transcode(uint8_t encode_mode, const char *text, uint8_t *out, size_t out_len);
+
+/**
+ * @brief Remember the VP and encode mode of a text SP without asking the display
+ * 
+ * @param sp SP address of the text control
+ * @param vp VP address the control displays
+ * @param encode_mode encode mode of the control, see #TEXT_ENCODE_UNICODE
+ */
+void dgus_text_set_encoding(uint16_t sp, uint16_t vp, uint8_t encode_mode);
+
+/**
+ * @brief Write UTF-8 text to a text control, transcoded to the control's encoding
+ * The VP and encode mode are read from the SP once and cached per SP address.
+ * 
+ * @param sp SP address of the text control. SP must be enabled unless dgus_text_set_encoding() was used
+ * @param text UTF-8 text. Must be null terminated
+ * @param len field length in bytes, padded with spaces. 0 to send just the text
+ * @return Response such as #DGUS_TIMEOUT or #DGUS_TEXT_ENCODING_UNSUPPORTED
+ */
+DGUS_RETURN dgus_set_text_utf8(uint16_t sp, const char *text, uint8_t len);
+
 /**
  * @brief Set the VP pointer address in memory
  * @note addr must be an SP address and SP must be enabled
@@ -0,0 +1,96 @@
+/**
+ * @file dgus_dispatch.c
+ * @author Barry Carter
+ * @date 01 Jan 2021
+ * @brief DGUS II LCD Address indexed dispatch of uploaded variables
+ */
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "dgus.h"
+#include "dgus_dispatch.h"
+
+typedef struct dispatch_entry_t {
+  uint16_t first;
+  uint16_t last;
+  dgus_var_handler_cb handler;
+  void *ctx;
+} dispatch_entry; /**< A VP range and its handler */
+
+/* Sorted by first address, ranges never overlap */
+static dispatch_entry _handlers[DISPATCH_MAX_HANDLERS];
+static uint16_t _handler_count;
+static packet_handler_cb _default_handler;
+
+/* Index of the first range starting after addr */
+static uint16_t _upper_bound(uint16_t addr) {
+  uint16_t lo = 0, hi = _handler_count;
+
+  while (lo < hi) {
+    uint16_t mid = (lo + hi) / 2;
+    if (_handlers[mid].first <= addr)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+DGUS_RETURN dgus_dispatch_register(uint16_t first, uint16_t last, dgus_var_handler_cb handler, void *ctx) {
+  if (last < first || !handler)
+    return DGUS_ERROR;
+  if (_handler_count >= DISPATCH_MAX_HANDLERS)
+    return DGUS_DISPATCH_TABLE_FULL;
+
+  uint16_t i = _upper_bound(first);
+  if (i > 0 && _handlers[i - 1].last >= first)
+    return DGUS_ERROR;
+  if (i < _handler_count && _handlers[i].first <= last)
+    return DGUS_ERROR;
+
+  memmove(&_handlers[i + 1], &_handlers[i], sizeof(dispatch_entry) * (_handler_count - i));
+  _handlers[i].first = first;
+  _handlers[i].last = last;
+  _handlers[i].handler = handler;
+  _handlers[i].ctx = ctx;
+  _handler_count++;
+
+  return DGUS_OK;
+}
+
+void dgus_dispatch_unregister(uint16_t first) {
+  uint16_t i = _upper_bound(first);
+
+  if (i == 0 || _handlers[i - 1].first != first)
+    return;
+
+  i--;
+  memmove(&_handlers[i], &_handlers[i + 1], sizeof(dispatch_entry) * (_handler_count - i - 1));
+  _handler_count--;
+}
+
+void dgus_dispatch_set_default(packet_handler_cb handler) {
+  _default_handler = handler;
+}
+
+void dgus_dispatch_packet(char *data, uint8_t cmd, uint8_t len, uint16_t addr, uint8_t bytelen) {
+  if (cmd == DGUS_CMD_VAR_R) {
+    uint16_t i = _upper_bound(addr);
+
+    if (i > 0 && addr <= _handlers[i - 1].last) {
+      dispatch_entry *e = &_handlers[i - 1];
+      // the parser already put the words in host order, copy them out aligned
+      uint16_t values[RECV_BUFFER_SIZE / 2];
+      uint8_t words = bytelen > RECV_BUFFER_SIZE / 2 ? RECV_BUFFER_SIZE / 2 : bytelen;
+
+      memcpy(values, data, words * 2);
+      e->handler(addr, values, words, e->ctx);
+      return;
+    }
+  }
+
+  if (_default_handler)
+    _default_handler(data, cmd, len, addr, bytelen);
+}
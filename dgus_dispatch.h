@@ -0,0 +1,57 @@
+#pragma once
+/**
+ * @file dgus_dispatch.h
+ * @author Barry Carter
+ * @date 01 Jan 2021
+ * @brief DGUS II LCD Address indexed dispatch of uploaded variables
+ */
+#include <stddef.h>
+#include <stdint.h>
+#include "dgus_reg.h"
+#include "dgus.h"
+
+#define DGUS_VALUE_I16(v, i) ((int16_t)(v)[i])                               /**< Signed word @p i of a handler's values */
+#define DGUS_VALUE_U32(v, i) (((uint32_t)(v)[i] << 16) | (v)[(i) + 1])       /**< Long at word @p i, high word first */
+#define DGUS_VALUE_I32(v, i) ((int32_t)DGUS_VALUE_U32(v, i))                 /**< Signed long at word @p i */
+
+/**
+ * @brief Handler for variables uploaded from a registered address range
+ *
+ * @param addr VP address of the first value
+ * @param values decoded words in host byte order
+ * @param words number of words
+ * @param ctx context given to dgus_dispatch_register()
+ */
+typedef void (*dgus_var_handler_cb)(uint16_t addr, const uint16_t *values, uint8_t words, void *ctx);
+
+/**
+ * @brief Route uploads from the VP range @p first to @p last to @p handler
+ * Ranges are kept in a sorted table and found with a binary search.
+ *
+ * @param first first VP address of the range
+ * @param last last VP address of the range, inclusive
+ * @param handler handler to call
+ * @param ctx passed to @p handler
+ * @return DGUS_RETURN #DGUS_DISPATCH_TABLE_FULL when DISPATCH_MAX_HANDLERS is reached,
+ * #DGUS_ERROR if the range overlaps an existing one
+ */
+DGUS_RETURN dgus_dispatch_register(uint16_t first, uint16_t last, dgus_var_handler_cb handler, void *ctx);
+
+/**
+ * @brief Remove the range starting at @p first
+ *
+ * @param first first VP address of the range
+ */
+void dgus_dispatch_unregister(uint16_t first);
+
+/**
+ * @brief Handler for packets no range claims, e.g. register reads
+ *
+ * @param handler packet handler, NULL to drop them
+ */
+void dgus_dispatch_set_default(packet_handler_cb handler);
+
+/**
+ * @brief Packet handler that dispatches by address. Pass it to dgus_init()
+ */
+void dgus_dispatch_packet(char *data, uint8_t cmd, uint8_t len, uint16_t addr, uint8_t bytelen);
@@ -0,0 +1,222 @@
+/**
+ * @file dgus_flash.c
+ * @author Barry Carter
+ * @date 01 Jan 2021
+ * @brief DGUS II LCD NOR flash storage
+ */
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "dgus.h"
+#include "dgus_flash.h"
+
+#define FLASH_SEND_WORDS ((SEND_BUFFER_SIZE - 2) / 2)   /**< VP words that fit one write frame */
+#define FLASH_RECV_WORDS ((RECV_BUFFER_SIZE - 3) / 2)   /**< VP words that fit one read reply */
+
+static uint16_t _window_vp = FLASH_WINDOW_VP;
+static uint16_t _window_words = FLASH_WINDOW_WORDS;
+
+DGUS_RETURN dgus_flash_set_window(uint16_t vp, uint16_t words) {
+  if ((vp & 1) || words < 4 || (words & 3))
+    return DGUS_FLASH_RANGE;
+
+  _window_vp = vp;
+  _window_words = words;
+  return DGUS_OK;
+}
+
+static DGUS_RETURN _flash_check(uint32_t flash_addr, uint32_t words) {
+  if (flash_addr & 1)
+    return DGUS_FLASH_RANGE;
+  if (flash_addr > FLASH_NOR_WORDS || words > FLASH_NOR_WORDS - flash_addr)
+    return DGUS_FLASH_RANGE;
+  return DGUS_OK;
+}
+
+/* Fill VAR space in as few frames as fit. Not scheduled, flash work must stay in order */
+static DGUS_RETURN _window_put(uint16_t vp, const uint16_t *data, uint16_t words) {
+  while (words) {
+    uint8_t frame[SEND_BUFFER_SIZE];
+    uint16_t n = words > FLASH_SEND_WORDS ? FLASH_SEND_WORDS : words;
+
+    frame[0] = vp >> 8;
+    frame[1] = vp & 0xFF;
+    for (uint16_t i = 0; i < n; i++) {
+      frame[2 + i * 2] = data[i] >> 8;
+      frame[3 + i * 2] = data[i] & 0xFF;
+    }
+    if (dgus_send_frame(DGUS_CMD_VAR_W, frame, 2 + n * 2) != DGUS_OK)
+      return DGUS_TIMEOUT;
+
+    vp += n;
+    data += n;
+    words -= n;
+  }
+  return DGUS_OK;
+}
+
+static DGUS_RETURN _window_get(uint16_t vp, uint16_t *data, uint16_t words) {
+  while (words) {
+    uint16_t n = words > FLASH_RECV_WORDS ? FLASH_RECV_WORDS : words;
+
+    DGUS_RETURN r = dgus_get_var(vp, data, n);
+    if (r != DGUS_OK)
+      return r;
+
+    vp += n;
+    data += n;
+    words -= n;
+  }
+  return DGUS_OK;
+}
+
+/* Start a copy between flash and VAR space. D7 mode, D6:D4 flash address, D3:D2 VP, D1:D0 words */
+static DGUS_RETURN _flash_start(uint8_t mode, uint32_t flash_addr, uint16_t vp, uint16_t words) {
+  uint8_t d[10] = {
+    NorFlashRWCmd >> 8, NorFlashRWCmd & 0xFF,
+    mode, (flash_addr >> 16) & 0xFF, (flash_addr >> 8) & 0xFF, flash_addr & 0xFF,
+    vp >> 8, vp & 0xFF, words >> 8, words & 0xFF
+  };
+  return dgus_send_frame(DGUS_CMD_VAR_W, d, sizeof(d));
+}
+
+/* The panel clears D7 once the copy is done */
+static DGUS_RETURN _flash_wait() {
+  for (int i = 0; i < FLASH_POLL_LIMIT; i++) {
+    uint16_t w = 0;
+    DGUS_RETURN r = dgus_get_var(NorFlashRWCmd, &w, 1);
+    if (r != DGUS_OK)
+      return r;
+    if ((w >> 8) == 0)
+      return DGUS_OK;
+  }
+  return DGUS_FLASH_BUSY;
+}
+
+DGUS_RETURN dgus_flash_write_stream(uint32_t flash_addr, uint32_t words, dgus_flash_source_cb source, void *ctx) {
+  uint16_t half = _window_words / 2;
+  uint16_t buf[FLASH_WINDOW_WORDS / 2];
+  uint8_t side = 0;
+  uint8_t busy = 0;
+  DGUS_RETURN r = _flash_check(flash_addr, words);
+
+  if (r != DGUS_OK)
+    return r;
+  if (words & 1)
+    return DGUS_FLASH_RANGE;
+  if (half > FLASH_WINDOW_WORDS / 2)
+    half = FLASH_WINDOW_WORDS / 2;
+
+  while (words) {
+    uint16_t n = words > half ? half : words;
+    uint16_t vp = _window_vp + side * half;
+
+    uint16_t want = n;
+    n = source(buf, n, ctx);
+    // a short chunk is the last one
+    if (n < want)
+      words = n;
+    // flash works in word pairs, pad a short final chunk
+    if (n & 1)
+      buf[n++] = 0xFFFF;
+    if (n == 0)
+      break;
+
+    // fill this half while the panel programs the other
+    r = _window_put(vp, buf, n);
+    if (r != DGUS_OK)
+      return r;
+
+    if (busy && (r = _flash_wait()) != DGUS_OK)
+      return r;
+
+    r = _flash_start(FLASH_MODE_WRITE, flash_addr, vp, n);
+    if (r != DGUS_OK)
+      return r;
+    busy = 1;
+
+    flash_addr += n;
+    words = n > words ? 0 : words - n;
+    side ^= 1;
+  }
+
+  return busy ? _flash_wait() : DGUS_OK;
+}
+
+DGUS_RETURN dgus_flash_read_stream(uint32_t flash_addr, uint32_t words, dgus_flash_sink_cb sink, void *ctx) {
+  uint16_t half = _window_words / 2;
+  uint16_t buf[FLASH_WINDOW_WORDS / 2];
+  uint8_t side = 0;
+  DGUS_RETURN r = _flash_check(flash_addr, words + (words & 1));
+
+  if (r != DGUS_OK)
+    return r;
+  if (words == 0)
+    return DGUS_OK;
+  if (half > FLASH_WINDOW_WORDS / 2)
+    half = FLASH_WINDOW_WORDS / 2;
+
+  // the first chunk has nothing to overlap with
+  uint16_t n = words > half ? half : words;
+  r = _flash_start(FLASH_MODE_READ, flash_addr, _window_vp, n + (n & 1));
+  if (r != DGUS_OK)
+    return r;
+
+  while (words) {
+    uint16_t vp = _window_vp + side * half;
+
+    if ((r = _flash_wait()) != DGUS_OK)
+      return r;
+
+    // start the next copy into the other half, then fetch this one while it runs
+    uint32_t rest = words - n;
+    uint16_t next = rest > half ? half : rest;
+    if (next) {
+      r = _flash_start(FLASH_MODE_READ, flash_addr + n, _window_vp + (side ^ 1) * half, next + (next & 1));
+      if (r != DGUS_OK)
+        return r;
+    }
+
+    r = _window_get(vp, buf, n);
+    if (r != DGUS_OK)
+      return r;
+    sink(buf, n, ctx);
+
+    flash_addr += n;
+    words = rest;
+    n = next;
+    side ^= 1;
+  }
+
+  return DGUS_OK;
+}
+
+typedef struct flash_cursor_t {
+  uint16_t *data;
+  uint32_t pos;
+} flash_cursor; /**< Position in a caller's buffer */
+
+static uint16_t _buffer_source(uint16_t *buf, uint16_t words, void *ctx) {
+  flash_cursor *c = ctx;
+  memcpy(buf, c->data + c->pos, words * 2);
+  c->pos += words;
+  return words;
+}
+
+static void _buffer_sink(const uint16_t *buf, uint16_t words, void *ctx) {
+  flash_cursor *c = ctx;
+  memcpy(c->data + c->pos, buf, words * 2);
+  c->pos += words;
+}
+
+DGUS_RETURN dgus_flash_write(uint32_t flash_addr, const uint16_t *data, uint32_t words) {
+  flash_cursor c = { (uint16_t *)data, 0 };
+  return dgus_flash_write_stream(flash_addr, words, _buffer_source, &c);
+}
+
+DGUS_RETURN dgus_flash_read(uint32_t flash_addr, uint16_t *data, uint32_t words) {
+  flash_cursor c = { data, 0 };
+  return dgus_flash_read_stream(flash_addr, words, _buffer_sink, &c);
+}
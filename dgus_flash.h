@@ -0,0 +1,87 @@
+#pragma once
+/**
+ * @file dgus_flash.h
+ * @author Barry Carter
+ * @date 01 Jan 2021
+ * @brief DGUS II LCD NOR flash storage
+ */
+#include <stddef.h>
+#include <stdint.h>
+#include "dgus_reg.h"
+#include "dgus.h"
+
+#define FLASH_MODE_READ   0x5A  /**< NorFlashRWCmd D7 to copy flash into VAR space */
+#define FLASH_MODE_WRITE  0xA5  /**< NorFlashRWCmd D7 to copy VAR space into flash */
+
+/**
+ * @brief Produce the next words to write to flash
+ *
+ * @param buf words to fill, host byte order
+ * @param words number of words wanted
+ * @param ctx context given to dgus_flash_write_stream()
+ * @return uint16_t words filled. Fewer than asked ends the stream early
+ */
+typedef uint16_t (*dgus_flash_source_cb)(uint16_t *buf, uint16_t words, void *ctx);
+
+/**
+ * @brief Consume words read from flash
+ *
+ * @param buf words read, host byte order
+ * @param words number of words in @p buf
+ * @param ctx context given to dgus_flash_read_stream()
+ */
+typedef void (*dgus_flash_sink_cb)(const uint16_t *buf, uint16_t words, void *ctx);
+
+/**
+ * @brief Move the VAR window flash data is staged through
+ * The window is split in two halves so one can be filled over serial while the panel
+ * copies the other to or from flash. It must not overlap any VP a page uses.
+ *
+ * @param vp first VP of the window, even
+ * @param words window size, a multiple of 4
+ * @return #DGUS_RETURN #DGUS_FLASH_RANGE if not aligned
+ */
+DGUS_RETURN dgus_flash_set_window(uint16_t vp, uint16_t words);
+
+/**
+ * @brief Stream words from a callback into NOR flash
+ * Flash writes work in even word counts from even addresses.
+ *
+ * @param flash_addr first flash word address, even
+ * @param words words to write, even
+ * @param source callback producing the data. A short chunk is written and ends the stream
+ * @param ctx passed to @p source
+ * @return #DGUS_RETURN #DGUS_FLASH_RANGE, #DGUS_FLASH_BUSY or #DGUS_TIMEOUT
+ */
+DGUS_RETURN dgus_flash_write_stream(uint32_t flash_addr, uint32_t words, dgus_flash_source_cb source, void *ctx);
+
+/**
+ * @brief Stream words from NOR flash into a callback
+ *
+ * @param flash_addr first flash word address, even
+ * @param words words to read
+ * @param sink callback receiving the data in order
+ * @param ctx passed to @p sink
+ * @return #DGUS_RETURN #DGUS_FLASH_RANGE, #DGUS_FLASH_BUSY or #DGUS_TIMEOUT
+ */
+DGUS_RETURN dgus_flash_read_stream(uint32_t flash_addr, uint32_t words, dgus_flash_sink_cb sink, void *ctx);
+
+/**
+ * @brief Write a buffer to NOR flash
+ *
+ * @param flash_addr first flash word address, even
+ * @param data words to write, host byte order
+ * @param words number of words, even
+ * @return #DGUS_RETURN
+ */
+DGUS_RETURN dgus_flash_write(uint32_t flash_addr, const uint16_t *data, uint32_t words);
+
+/**
+ * @brief Read NOR flash into a buffer
+ *
+ * @param flash_addr first flash word address, even
+ * @param data buffer for the words, host byte order
+ * @param words number of words
+ * @return #DGUS_RETURN
+ */
+DGUS_RETURN dgus_flash_read(uint32_t flash_addr, uint16_t *data, uint32_t words);
@@ -0,0 +1,142 @@
+/**
+ * @file dgus_jpeg.c
+ * @author Barry Carter
+ * @date 01 Jan 2021
+ * @brief DGUS II LCD JPEG streaming through JpegDownload
+ */
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "dgus.h"
+#include "dgus_jpeg.h"
+#include "dgus_tx.h"
+#if JPEG_POSIX_FD
+#include <unistd.h>
+#include <sys/stat.h>
+#endif
+
+#define JPEG_FRAME_BYTES ((SEND_BUFFER_SIZE - 2) & ~1)  /**< data bytes per write frame, the most a frame holds */
+
+/* Staging slots, used in turn */
+static const uint16_t _slots[2] = { JPEG_SLOT_A, JPEG_SLOT_B };
+static uint8_t _slot;
+static uint8_t _busy;
+static dgus_jpeg_stats _stats;
+
+DGUS_RETURN dgus_jpeg_wait() {
+  if (!_busy)
+    return DGUS_OK;
+
+  for (int i = 0; i < FLASH_POLL_LIMIT; i++) {
+    uint16_t w = 0;
+    DGUS_RETURN r = dgus_get_var(JpegDownload, &w, 1);
+    if (r != DGUS_OK)
+      return r;
+    if ((w >> 8) == 0) {
+      _busy = 0;
+      return DGUS_OK;
+    }
+  }
+  return DGUS_FLASH_BUSY;
+}
+
+/* Fill a slot in full frames */
+static DGUS_RETURN _jpeg_stage(uint16_t vp, uint32_t len, dgus_jpeg_read_cb read, void *ctx) {
+  uint8_t frame[2 + JPEG_FRAME_BYTES];
+
+  while (len) {
+    uint32_t n = len > JPEG_FRAME_BYTES ? JPEG_FRAME_BYTES : len;
+
+    if (read(&frame[2], n, ctx) != n)
+      return DGUS_ERROR;
+    if (n & 1)
+      frame[2 + n++] = 0xFF;
+
+    frame[0] = vp >> 8;
+    frame[1] = vp & 0xFF;
+    if (dgus_send_frame(DGUS_CMD_VAR_W, frame, 2 + n) != DGUS_OK)
+      return DGUS_TIMEOUT;
+
+    vp += n / 2;
+    len = n > len ? 0 : len - n;
+  }
+  return DGUS_OK;
+}
+
+/* D7 start, D6 0, D5:D4 VP of the JPEG, D3:D2 x, D1:D0 y */
+static DGUS_RETURN _jpeg_decode(uint16_t vp, uint16_t x, uint16_t y) {
+  uint8_t d[10] = {
+    JpegDownload >> 8, JpegDownload & 0xFF,
+    JPEG_CMD_START, 0x00, vp >> 8, vp & 0xFF, x >> 8, x & 0xFF, y >> 8, y & 0xFF
+  };
+  return dgus_send_frame(DGUS_CMD_VAR_W, d, sizeof(d));
+}
+
+DGUS_RETURN dgus_jpeg_show_stream(uint32_t len, dgus_jpeg_read_cb read, void *ctx, uint16_t x, uint16_t y) {
+  uint32_t start = dgus_tx_millis();
+  DGUS_RETURN r;
+
+  if (len == 0 || len > JPEG_SLOT_WORDS * 2)
+    return DGUS_JPEG_TOO_LARGE;
+
+  // the other slot may still be decoding
+  uint16_t vp = _slots[_slot];
+  if ((r = _jpeg_stage(vp, len, read, ctx)) != DGUS_OK)
+    return r;
+  if ((r = dgus_jpeg_wait()) != DGUS_OK)
+    return r;
+  if ((r = _jpeg_decode(vp, x, y)) != DGUS_OK)
+    return r;
+
+  _busy = 1;
+  _slot ^= 1;
+  _stats.frames++;
+  _stats.bytes += len;
+  _stats.ms += dgus_tx_millis() - start;
+  return DGUS_OK;
+}
+
+static uint32_t _mem_read(uint8_t *buf, uint32_t len, void *ctx) {
+  const uint8_t **p = ctx;
+  memcpy(buf, *p, len);
+  *p += len;
+  return len;
+}
+
+DGUS_RETURN dgus_jpeg_show(const uint8_t *data, uint32_t len, uint16_t x, uint16_t y) {
+  const uint8_t *p = data;
+  return dgus_jpeg_show_stream(len, _mem_read, &p, x, y);
+}
+
+void dgus_jpeg_get_stats(dgus_jpeg_stats *stats, uint8_t reset) {
+  *stats = _stats;
+  if (reset)
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+#if JPEG_POSIX_FD
+static uint32_t _fd_read(uint8_t *buf, uint32_t len, void *ctx) {
+  int fd = *(int *)ctx;
+  uint32_t got = 0;
+
+  while (got < len) {
+    ssize_t n = read(fd, buf + got, len - got);
+    if (n <= 0)
+      break;
+    got += n;
+  }
+  return got;
+}
+
+DGUS_RETURN dgus_jpeg_show_fd(int fd, uint16_t x, uint16_t y) {
+  struct stat st;
+  off_t pos = lseek(fd, 0, SEEK_CUR);
+
+  if (fstat(fd, &st) != 0 || pos < 0 || st.st_size <= pos)
+    return DGUS_ERROR;
+
+  return dgus_jpeg_show_stream(st.st_size - pos, _fd_read, &fd, x, y);
+}
+#endif
@@ -0,0 +1,85 @@
+#pragma once
+/**
+ * @file dgus_jpeg.h
+ * @author Barry Carter
+ * @date 01 Jan 2021
+ * @brief DGUS II LCD JPEG streaming through JpegDownload
+ */
+#include <stddef.h>
+#include <stdint.h>
+#include "dgus_reg.h"
+#include "dgus.h"
+
+#define JPEG_CMD_START 0x5A     /**< JpegDownload D7 to decode, cleared by the panel when shown */
+
+/**
+ * @brief Throughput of JPEG streaming since the last reset
+ */
+typedef struct dgus_jpeg_stats {
+  uint32_t frames;              /**< images shown */
+  uint32_t bytes;               /**< JPEG bytes sent */
+  uint32_t ms;                  /**< time spent in the JPEG calls, by the dgus_tx_set_clock() clock */
+} dgus_jpeg_stats;
+
+/**
+ * @brief Read the next JPEG bytes
+ *
+ * @param buf buffer to fill
+ * @param len bytes wanted
+ * @param ctx context given to dgus_jpeg_show_stream()
+ * @return uint32_t bytes read, less than @p len only on error
+ */
+typedef uint32_t (*dgus_jpeg_read_cb)(uint8_t *buf, uint32_t len, void *ctx);
+
+/**
+ * @brief Show a JPEG read from a callback at @p x, @p y on the current page
+ * The image is staged into one of two VAR slots while the panel may still be decoding
+ * the previous image from the other, then decoding is started and the call returns.
+ * Consecutive images therefore overlap transfer with decoding.
+ *
+ * @param len JPEG size in bytes, at most JPEG_SLOT_WORDS * 2
+ * @param read callback producing the bytes in order
+ * @param ctx passed to @p read
+ * @param x left of the image
+ * @param y top of the image
+ * @return #DGUS_RETURN #DGUS_JPEG_TOO_LARGE, #DGUS_FLASH_BUSY if the previous image never finished
+ */
+DGUS_RETURN dgus_jpeg_show_stream(uint32_t len, dgus_jpeg_read_cb read, void *ctx, uint16_t x, uint16_t y);
+
+/**
+ * @brief Show a JPEG held in memory, e.g. a mapped file or a camera buffer
+ *
+ * @param data JPEG bytes
+ * @param len JPEG size in bytes
+ * @param x left of the image
+ * @param y top of the image
+ * @return #DGUS_RETURN
+ */
+DGUS_RETURN dgus_jpeg_show(const uint8_t *data, uint32_t len, uint16_t x, uint16_t y);
+
+/**
+ * @brief Wait until the last image has been decoded and shown
+ *
+ * @return #DGUS_RETURN #DGUS_FLASH_BUSY if it never finished
+ */
+DGUS_RETURN dgus_jpeg_wait();
+
+/**
+ * @brief Throughput since the last reset. Frame rate is frames * 1000 / ms
+ *
+ * @param stats filled with the counters
+ * @param reset 1 to start counting again
+ */
+void dgus_jpeg_get_stats(dgus_jpeg_stats *stats, uint8_t reset);
+
+#if JPEG_POSIX_FD
+/**
+ * @brief Show a JPEG from a file descriptor, read from its current position to the end
+ *
+ * @param fd open file descriptor
+ * @param x left of the image
+ * @param y top of the image
+ * @return #DGUS_RETURN #DGUS_ERROR if the file cannot be read
+ */
+DGUS_RETURN dgus_jpeg_show_fd(int fd, uint16_t x, uint16_t y);
+#endif
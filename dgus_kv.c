@@ -0,0 +1,508 @@
+/**
+ * @file dgus_kv.c
+ * @author Barry Carter
+ * @date 01 Jan 2021
+ * @brief DGUS II LCD Key-value store on the panel's NOR flash
+ */
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "dgus.h"
+#include "dgus_kv.h"
+#include "dgus_flash.h"
+
+#define KV_HEADER_WORDS 4       /**< marker | key | len | sum, also the size of a half header */
+#define KV_SUM_SEED     0x5AA5
+
+typedef struct kv_entry_t {
+  uint16_t key;
+  uint16_t len;                 /**< value bytes, KV_TOMBSTONE while a delete waits for compaction */
+  uint16_t sum;
+  uint8_t copied;               /**< already copied by the running compaction */
+  uint32_t addr;                /**< flash word address of the value */
+  uint32_t new_addr;            /**< where the running compaction put it */
+  uint8_t value[KV_INLINE_BYTES];
+} kv_entry; /**< Latest location of a key */
+
+/* Sorted by key */
+static kv_entry _index[KV_MAX_KEYS];
+static uint16_t _index_count;
+
+static uint8_t _mounted;
+static uint32_t _base;
+static uint32_t _half_words;
+static uint8_t _active;
+static uint16_t _gen;
+static uint32_t _committed;             /**< end of what is in flash, the batch goes here */
+
+static uint16_t _batch[KV_BATCH_WORDS]; /**< appended records not yet written */
+static uint16_t _batch_used;
+
+/* Compaction into the other half */
+static uint8_t _compacting;
+static uint32_t _cstart;                /**< where _cbatch goes */
+static uint16_t _cbatch[KV_BATCH_WORDS];
+static uint16_t _cbatch_used;
+static DGUS_RETURN _compact_error;      /**< last background step result, DGUS_KV_FULL stops retries */
+static uint32_t _compacted_end;         /**< log end right after the last compaction */
+
+static uint32_t _half_start(uint8_t half) {
+  return _base + half * _half_words;
+}
+
+static uint16_t _value_words(uint16_t len) {
+  return len == KV_TOMBSTONE ? 0 : (len + 1) / 2;
+}
+
+/* Records stay word pair aligned for the flash */
+static uint16_t _record_words(uint16_t len) {
+  uint16_t n = KV_HEADER_WORDS + _value_words(len);
+  return (n + 1) & ~1;
+}
+
+static uint16_t _sum(uint16_t key, uint16_t len, const uint16_t *words) {
+  uint16_t s = KV_SUM_SEED ^ key ^ len;
+  for (uint16_t i = 0; i < _value_words(len); i++)
+    s += words[i];
+  return s;
+}
+
+/* Value bytes to words, first byte high */
+static void _pack(const uint8_t *bytes, uint16_t len, uint16_t *words) {
+  for (uint16_t i = 0; i < len; i += 2)
+    words[i / 2] = ((uint16_t)bytes[i] << 8) | (i + 1 < len ? bytes[i + 1] : 0);
+}
+
+static void _unpack(const uint16_t *words, uint16_t len, uint8_t *bytes) {
+  for (uint16_t i = 0; i < len; i++)
+    bytes[i] = (i & 1) ? (words[i / 2] & 0xFF) : (words[i / 2] >> 8);
+}
+
+/* Build a record. Returns its size in words */
+static uint16_t _record(uint16_t *out, uint16_t key, uint16_t len, const uint16_t *value, uint16_t gen) {
+  uint16_t n = _record_words(len);
+
+  out[0] = KV_MARKER | (gen & 0xFF);
+  out[1] = key;
+  out[2] = len;
+  out[3] = _sum(key, len, value);
+  memcpy(&out[KV_HEADER_WORDS], value, _value_words(len) * 2);
+  // padding word
+  if (KV_HEADER_WORDS + _value_words(len) < n)
+    out[n - 1] = 0xFFFF;
+  return n;
+}
+
+static int _find(uint16_t key, uint8_t *exact) {
+  int lo = 0, hi = _index_count;
+
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    if (_index[mid].key < key)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  *exact = lo < _index_count && _index[lo].key == key;
+  return lo;
+}
+
+static kv_entry *_upsert(uint16_t key) {
+  uint8_t exact;
+  int i = _find(key, &exact);
+
+  if (exact)
+    return &_index[i];
+  if (_index_count >= KV_MAX_KEYS)
+    return NULL;
+
+  memmove(&_index[i + 1], &_index[i], sizeof(kv_entry) * (_index_count - i));
+  memset(&_index[i], 0, sizeof(kv_entry));
+  _index[i].key = key;
+  _index_count++;
+  return &_index[i];
+}
+
+static void _remove(uint16_t key) {
+  uint8_t exact;
+  int i = _find(key, &exact);
+
+  if (!exact)
+    return;
+  memmove(&_index[i], &_index[i + 1], sizeof(kv_entry) * (_index_count - i - 1));
+  _index_count--;
+}
+
+/* Point an entry at a record */
+static void _apply(kv_entry *e, const uint16_t *rec, uint32_t addr) {
+  e->len = rec[2];
+  e->sum = rec[3];
+  e->addr = addr + KV_HEADER_WORDS;
+  e->copied = 0;
+  if (e->len != KV_TOMBSTONE && e->len <= KV_INLINE_BYTES)
+    _unpack(&rec[KV_HEADER_WORDS], e->len, e->value);
+}
+
+/* Value words of an entry, wherever they are */
+static DGUS_RETURN _load(kv_entry *e, uint16_t *words) {
+  uint16_t n = _value_words(e->len);
+
+  if (e->addr >= _committed) {
+    memcpy(words, &_batch[e->addr - _committed], n * 2);
+  }
+  else if (e->len <= KV_INLINE_BYTES) {
+    _pack(e->value, e->len, words);
+  }
+  else {
+    DGUS_RETURN r = dgus_flash_read(e->addr, words, n);
+    if (r != DGUS_OK)
+      return r;
+  }
+
+  if (_sum(e->key, e->len, words) != e->sum)
+    return DGUS_KV_CORRUPT;
+  return DGUS_OK;
+}
+
+static DGUS_RETURN _write_half_header(uint8_t half, uint16_t gen) {
+  uint16_t h[KV_HEADER_WORDS] = { KV_HALF_MAGIC0, KV_HALF_MAGIC1, gen, ~gen };
+  return dgus_flash_write(_half_start(half), h, KV_HEADER_WORDS);
+}
+
+/* Generation of a half, 0 if it holds no log */
+static uint16_t _read_half_header(uint8_t half) {
+  uint16_t h[KV_HEADER_WORDS];
+
+  if (dgus_flash_read(_half_start(half), h, KV_HEADER_WORDS) != DGUS_OK)
+    return 0;
+  if (h[0] != KV_HALF_MAGIC0 || h[1] != KV_HALF_MAGIC1 || h[2] != (uint16_t)~h[3])
+    return 0;
+  return h[2];
+}
+
+/* Build the index from the active half. The log ends at the first record of another generation */
+static DGUS_RETURN _scan() {
+  uint16_t chunk[KV_SCAN_WORDS];
+  uint32_t end = _half_start(_active) + _half_words;
+  uint32_t pos = _half_start(_active) + KV_HEADER_WORDS;
+  uint32_t i = 0;
+
+  _index_count = 0;
+  while (pos + KV_HEADER_WORDS <= end) {
+    uint32_t got = end - pos > KV_SCAN_WORDS ? KV_SCAN_WORDS : end - pos;
+    i = 0;
+
+    DGUS_RETURN r = dgus_flash_read(pos, chunk, got);
+    if (r != DGUS_OK)
+      return r;
+
+    while (i + KV_HEADER_WORDS <= got) {
+      uint16_t *rec = &chunk[i];
+      if (rec[0] != (KV_MARKER | (_gen & 0xFF)))
+        goto done;
+
+      uint16_t len = rec[2];
+      uint16_t n = _record_words(len);
+      uint8_t inl = len != KV_TOMBSTONE && len <= KV_INLINE_BYTES;
+
+      // record must fit the half, and small values are checked now
+      if (pos + i + n > end)
+        goto done;
+      if (inl && i + KV_HEADER_WORDS + _value_words(len) > got)
+        break;
+      if (inl && _sum(rec[1], len, &rec[KV_HEADER_WORDS]) != rec[3])
+        goto done;
+
+      if (len == KV_TOMBSTONE) {
+        _remove(rec[1]);
+      }
+      else {
+        kv_entry *e = _upsert(rec[1]);
+        if (!e)
+          return DGUS_KV_FULL;
+        _apply(e, rec, pos + i);
+      }
+      i += n;
+    }
+
+    if (i == 0)
+      break;
+    pos += i;
+    i = 0;
+  }
+
+done:
+  _committed = pos + i;
+  return DGUS_OK;
+}
+
+DGUS_RETURN dgus_kv_mount(uint32_t flash_addr, uint32_t words) {
+  if ((flash_addr & 3) || (words & 3) || words < 4 * KV_BATCH_WORDS)
+    return DGUS_FLASH_RANGE;
+
+  _mounted = 0;
+  _base = flash_addr;
+  _half_words = words / 2;
+  _batch_used = 0;
+  _compacting = 0;
+  _compact_error = DGUS_OK;
+  _compacted_end = 0;
+
+  uint16_t g0 = _read_half_header(0);
+  uint16_t g1 = _read_half_header(1);
+
+  if (!g0 && !g1) {
+    // fresh region
+    _active = 0;
+    _gen = 1;
+    _index_count = 0;
+    _committed = _half_start(0) + KV_HEADER_WORDS;
+    DGUS_RETURN r = _write_half_header(0, _gen);
+    if (r != DGUS_OK)
+      return r;
+    _mounted = 1;
+    return DGUS_OK;
+  }
+
+  // the newer half wins, with wraparound
+  _active = !g0 ? 1 : !g1 ? 0 : (int16_t)(g1 - g0) > 0;
+  _gen = _active ? g1 : g0;
+
+  DGUS_RETURN r = _scan();
+  if (r == DGUS_OK)
+    _mounted = 1;
+  return r;
+}
+
+DGUS_RETURN dgus_kv_commit() {
+  if (!_mounted || _batch_used == 0)
+    return DGUS_OK;
+
+  DGUS_RETURN r = dgus_flash_write(_committed, _batch, _batch_used);
+  if (r != DGUS_OK)
+    return r;
+
+  _committed += _batch_used;
+  _batch_used = 0;
+  return DGUS_OK;
+}
+
+static DGUS_RETURN _cflush() {
+  if (_cbatch_used == 0)
+    return DGUS_OK;
+
+  DGUS_RETURN r = dgus_flash_write(_cstart, _cbatch, _cbatch_used);
+  if (r != DGUS_OK)
+    return r;
+
+  _cstart += _cbatch_used;
+  _cbatch_used = 0;
+  return DGUS_OK;
+}
+
+static void _compact_begin() {
+  _compacting = 1;
+  _cstart = _half_start(!_active) + KV_HEADER_WORDS;
+  _cbatch_used = 0;
+  for (uint16_t i = 0; i < _index_count; i++)
+    _index[i].copied = 0;
+}
+
+/* Copy up to @p max records to the other half. Switches halves once everything live is there */
+static DGUS_RETURN _compact_step(uint16_t max, uint8_t *copied) {
+  uint16_t value[KV_BATCH_WORDS];
+  uint32_t end = _half_start(!_active) + _half_words;
+  // 0 marks a half with no log
+  uint16_t gen = (uint16_t)(_gen + 1) ? _gen + 1 : 1;
+  DGUS_RETURN r;
+
+  *copied = 0;
+  for (uint16_t i = 0; i < _index_count && *copied < max; i++) {
+    kv_entry *e = &_index[i];
+    if (e->copied)
+      continue;
+
+    uint16_t n = _record_words(e->len);
+    if (e->len != KV_TOMBSTONE && (r = _load(e, value)) != DGUS_OK)
+      return r;
+
+    if (_cbatch_used + n > KV_BATCH_WORDS && (r = _cflush()) != DGUS_OK)
+      return r;
+    if (_cstart + _cbatch_used + n > end) {
+      _compacting = 0;
+      return DGUS_KV_FULL;
+    }
+
+    e->new_addr = _cstart + _cbatch_used + KV_HEADER_WORDS;
+    _cbatch_used += _record(&_cbatch[_cbatch_used], e->key, e->len, value, gen);
+    e->copied = 1;
+    (*copied)++;
+  }
+
+  for (uint16_t i = 0; i < _index_count; i++) {
+    if (!_index[i].copied)
+      return DGUS_OK;
+  }
+
+  // everything live is across. The header is the commit point
+  if ((r = _cflush()) != DGUS_OK)
+    return r;
+  if ((r = _write_half_header(!_active, gen)) != DGUS_OK)
+    return r;
+
+  _active = !_active;
+  _gen = gen;
+  _committed = _cstart;
+  _compacted_end = _cstart;
+  // the batch was meant for the old half and everything in it has been copied
+  _batch_used = 0;
+  _compacting = 0;
+
+  uint16_t o = 0;
+  for (uint16_t i = 0; i < _index_count; i++) {
+    if (_index[i].len == KV_TOMBSTONE)
+      continue;
+    _index[i].addr = _index[i].new_addr;
+    _index[o++] = _index[i];
+  }
+  _index_count = o;
+
+  return DGUS_OK;
+}
+
+static DGUS_RETURN _compact_all() {
+  uint8_t copied;
+  DGUS_RETURN r;
+
+  if (!_compacting)
+    _compact_begin();
+  while (_compacting) {
+    if ((r = _compact_step(KV_MAX_KEYS, &copied)) != DGUS_OK)
+      return r;
+  }
+  return DGUS_OK;
+}
+
+uint8_t dgus_kv_service() {
+  uint8_t copied = 0;
+
+  if (!_mounted)
+    return 0;
+
+  if (!_compacting) {
+    // the live set did not fit the other half, retrying cannot help until it changes
+    if (_compact_error == DGUS_KV_FULL)
+      return 0;
+    // nothing written since the last compaction, the live set alone is over the mark
+    if (_committed + _batch_used == _compacted_end)
+      return 0;
+    uint32_t used = _committed + _batch_used - _half_start(_active);
+    if (used * 100 < _half_words * KV_COMPACT_PERCENT)
+      return 0;
+    _compact_begin();
+  }
+
+  _compact_error = _compact_step(KV_COMPACT_STEP, &copied);
+  return copied;
+}
+
+DGUS_RETURN dgus_kv_compact_error() {
+  return _compact_error;
+}
+
+/* Append a record to the batch and point the index at it */
+static DGUS_RETURN _append(uint16_t key, uint16_t len, const uint16_t *value) {
+  uint16_t n = _record_words(len);
+  uint32_t end = _half_start(_active) + _half_words;
+  DGUS_RETURN r;
+
+  if (n > KV_BATCH_WORDS)
+    return DGUS_ERROR;
+
+  if (_committed + _batch_used + n > end) {
+    // out of room, copy the live set across now
+    if ((r = dgus_kv_commit()) != DGUS_OK || (r = _compact_all()) != DGUS_OK)
+      return r;
+    end = _half_start(_active) + _half_words;
+    if (_committed + n > end)
+      return DGUS_KV_FULL;
+  }
+  if (_batch_used + n > KV_BATCH_WORDS && (r = dgus_kv_commit()) != DGUS_OK)
+    return r;
+
+  kv_entry *e = _upsert(key);
+  if (!e)
+    return DGUS_KV_FULL;
+
+  uint16_t *rec = &_batch[_batch_used];
+  _record(rec, key, len, value, _gen);
+  _apply(e, rec, _committed + _batch_used);
+  _batch_used += n;
+  // a delete shrinks the live set, background compaction may fit now
+  if (len == KV_TOMBSTONE && _compact_error == DGUS_KV_FULL)
+    _compact_error = DGUS_OK;
+
+  return DGUS_OK;
+}
+
+DGUS_RETURN dgus_kv_put(uint16_t key, const void *value, uint16_t len) {
+  uint16_t words[KV_BATCH_WORDS];
+
+  if (!_mounted)
+    return DGUS_ERROR;
+  if (len == KV_TOMBSTONE || _record_words(len) > KV_BATCH_WORDS)
+    return DGUS_ERROR;
+
+  _pack(value, len, words);
+  return _append(key, len, words);
+}
+
+DGUS_RETURN dgus_kv_delete(uint16_t key) {
+  uint8_t exact;
+  int i = _find(key, &exact);
+
+  if (!_mounted)
+    return DGUS_ERROR;
+  if (!exact || _index[i].len == KV_TOMBSTONE)
+    return DGUS_KV_NOT_FOUND;
+
+  DGUS_RETURN r = _append(key, KV_TOMBSTONE, NULL);
+  if (r != DGUS_OK)
+    return r;
+
+  // a running compaction has to carry the delete across, otherwise forget the key now
+  if (!_compacting)
+    _remove(key);
+  return DGUS_OK;
+}
+
+DGUS_RETURN dgus_kv_get(uint16_t key, void *value, uint16_t *len) {
+  uint16_t words[KV_BATCH_WORDS];
+  uint8_t exact;
+  int i = _find(key, &exact);
+
+  if (!exact || _index[i].len == KV_TOMBSTONE)
+    return DGUS_KV_NOT_FOUND;
+
+  kv_entry *e = &_index[i];
+  if (*len < e->len) {
+    *len = e->len;
+    return DGUS_ERROR;
+  }
+
+  // small values never leave RAM
+  if (e->len <= KV_INLINE_BYTES) {
+    memcpy(value, e->value, e->len);
+  }
+  else {
+    DGUS_RETURN r = _load(e, words);
+    if (r != DGUS_OK)
+      return r;
+    _unpack(words, e->len, value);
+  }
+
+  *len = e->len;
+  return DGUS_OK;
+}
@@ -0,0 +1,85 @@
+#pragma once
+/**
+ * @file dgus_kv.h
+ * @author Barry Carter
+ * @date 01 Jan 2021
+ * @brief DGUS II LCD Key-value store on the panel's NOR flash
+ */
+#include <stddef.h>
+#include <stdint.h>
+#include "dgus_reg.h"
+#include "dgus.h"
+
+#define KV_HALF_MAGIC0   0x4B56   /**< "KV", first word of an active log half */
+#define KV_HALF_MAGIC1   0x4C47   /**< "LG" */
+#define KV_MARKER        0x4B00   /**< Record marker, low byte carries the log generation */
+#define KV_TOMBSTONE     0xFFFF   /**< Record length marking a deleted key */
+
+/**
+ * @brief Open the store kept in a NOR flash region, formatting it if it holds none
+ * The region is split in two halves. Records are appended to one half until it fills,
+ * then the live ones are copied to the other. Mounting scans the active half once to
+ * build the RAM index, after which reads never scan.
+ *
+ * @param flash_addr first flash word address, a multiple of 4
+ * @param words region size in words, a multiple of 4
+ * @return #DGUS_RETURN #DGUS_KV_FULL if the log holds more keys than KV_MAX_KEYS
+ */
+DGUS_RETURN dgus_kv_mount(uint32_t flash_addr, uint32_t words);
+
+/**
+ * @brief Set a value. It is buffered with other puts and written by dgus_kv_commit()
+ * or when the buffer fills
+ *
+ * @param key key id
+ * @param value bytes to store
+ * @param len number of bytes, at most (KV_BATCH_WORDS - 4) * 2
+ * @return #DGUS_RETURN #DGUS_KV_FULL when the index or the flash region is full
+ */
+DGUS_RETURN dgus_kv_put(uint16_t key, const void *value, uint16_t len);
+
+/**
+ * @brief Get a value from the index. Values up to KV_INLINE_BYTES are served from RAM,
+ * longer ones with a single flash read
+ *
+ * @param key key id
+ * @param value buffer for the bytes
+ * @param len in: size of @p value, out: size of the stored value
+ * @return #DGUS_RETURN #DGUS_KV_NOT_FOUND, #DGUS_KV_CORRUPT if the flash copy fails its checksum,
+ * #DGUS_ERROR if @p value is too small
+ */
+DGUS_RETURN dgus_kv_get(uint16_t key, void *value, uint16_t *len);
+
+/**
+ * @brief Remove a key
+ *
+ * @param key key id
+ * @return #DGUS_RETURN #DGUS_KV_NOT_FOUND
+ */
+DGUS_RETURN dgus_kv_delete(uint16_t key);
+
+/**
+ * @brief Write buffered puts and deletes to flash in one operation
+ *
+ * @return #DGUS_RETURN
+ */
+DGUS_RETURN dgus_kv_commit();
+
+/**
+ * @brief Do a slice of background compaction once the active half is KV_COMPACT_PERCENT full
+ * Call it in your main loop. Each call copies at most KV_COMPACT_STEP records.
+ * Nothing runs again until records are written after a compaction.
+ * A step that fails is reported by dgus_kv_compact_error(). After #DGUS_KV_FULL no further
+ * compaction is started until a key is deleted.
+ *
+ * @return uint8_t records copied
+ */
+uint8_t dgus_kv_service();
+
+/**
+ * @brief Result of the last compaction step run by dgus_kv_service()
+ *
+ * @return #DGUS_RETURN #DGUS_KV_FULL if the live set does not fit half the region,
+ * or the flash error that interrupted the step. The step resumes on the next call
+ */
+DGUS_RETURN dgus_kv_compact_error();
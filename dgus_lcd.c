@@ -11,10 +11,14 @@
 #include <stddef.h>
 #include <time.h> 
 #include "dgus.h"
+#include "dgus_page.h"
+#include "dgus_tx.h"
+#include "dgus_capture.h"
 
 static uint8_t _ack_mode = ACK_MODE;
 
 static int _handle_packet(char *data, uint8_t cmd, uint8_t len);
+static int _recv_parse();
 
 
 static void _delay(int ms) 
@@ -38,6 +42,38 @@ static ser_available_handler_cb _ser_avail_handler;     /**< function to get num
 static uint8_t recvlen;
 static uint8_t recvcmd;
 static uint8_t recvdata[RECV_BUFFER_SIZE];              /**< recv buffer */
+static uint8_t _stage[RECV_STAGING_SIZE];               /**< raw bytes from the port, not yet framed */
+static uint16_t _stage_len;
+static uint32_t _recv_discarded;                        /**< bytes skipped while resynchronising */
+static ser_read_handler_cb _ser_read_handler;           /**< optional bulk read */
+static uint16_t recvaddr;                               /**< VP of the last VAR read frame */
+static uint8_t recvwords;                               /**< word count of the last VAR read frame */
+
+/* The VAR read that _polling_wait() should match */
+static uint8_t _expect_read;
+static uint16_t _expect_addr;
+static uint8_t _expect_words;
+
+/* Host serial port rate */
+static ser_baud_handler_cb _ser_baud_handler;
+static uint32_t _ser_baud;
+
+#if EVENT_QUEUE_ENTRIES
+typedef struct dgus_event_t {
+  uint8_t cmd;
+  uint8_t len;
+  uint8_t bytelen;
+  uint16_t addr;
+  char data[RECV_BUFFER_SIZE];
+} dgus_event; /**< A parsed packet waiting for the handler */
+
+/* Events are handed to the packet handler outside the parser */
+static dgus_event _events[EVENT_QUEUE_ENTRIES];
+static uint8_t _event_head;
+static uint8_t _event_count;
+static uint16_t _events_dropped;
+static uint8_t _events_draining;
+#endif
 
 /**
  * @brief  A packet header that every packet needs 
@@ -67,6 +103,10 @@ typedef struct __attribute__((packed)) dgus_var_data_t {
   uint16_t data[16];
 } dgus_var_data; /**< Header for a VAR command */
 
+/* Packets handed out by dgus_packet_acquire() */
+static dgus_packet _packet_pool[PACKET_POOL_SIZE];
+static uint8_t _packet_used[PACKET_POOL_SIZE];
+
 
 
 void dgus_init(ser_available_handler_cb avail, ser_recv_handler_cb recv, ser_send_handler_cb send, packet_handler_cb packet_handler) {
@@ -74,6 +114,11 @@ void dgus_init(ser_available_handler_cb avail, ser_recv_handler_cb recv, ser_sen
   _ser_recv_handler = recv;
   _ser_send_handler = send;
   _ser_avail_handler = avail;
+#if EVENT_QUEUE_ENTRIES
+  _event_head = 0;
+  _event_count = 0;
+  _events_dropped = 0;
+#endif
   /* Intializes random number generator */
   time_t t;
   srand((unsigned) time(&t));
@@ -98,12 +143,17 @@ static DGUS_RETURN _polling_wait_for_ok() {
 
   int timer = SEND_TIMEOUT;
   int r = 0;
-  while(r <= 0) {
-    r = dgus_recv_data();
+  while(1) {
+    r = _recv_parse();
     if (r == PACKET_OK) {
       // we got an OK. What do we want to do with it?
       return DGUS_OK;
     }
+#if EVENT_QUEUE_ENTRIES
+    // a touch upload is queued, keep waiting for the ACK
+    if (r > 0)
+      continue;
+#endif
     // timeout
     _delay(1);
     if (timer == 0) {
@@ -117,20 +167,29 @@ static DGUS_RETURN _polling_wait_for_ok() {
 
 DGUS_RETURN _polling_wait() {
   int timer = SEND_TIMEOUT;
-  while(dgus_recv_data() <= 0) {
+  int r;
+  while((r = _recv_parse()) <= 0 ||
+        (_expect_read && (recvcmd != DGUS_CMD_VAR_R || recvaddr != _expect_addr || recvwords != _expect_words))) {
+    // a touch or other upload, already queued. Keep waiting for our reply
+    if (r > 0)
+      continue;
     // timeout
     _delay(1);
     if (timer == 0) {
       DEBUG_PRINTF("TIMEOUT!\n");
+      // a late reply goes to the handler like any upload
+      _expect_read = 0;
       return DGUS_TIMEOUT;
     }
     timer--;
   }
+  _expect_read = 0;
   return DGUS_OK;
 }
 
 
-DGUS_RETURN send_data(enum command cmd, dgus_packet *p) {
+/* Put a packet on the wire. Does not wait for the ACK or reply */
+static void _transmit_raw(enum command cmd, dgus_packet *p) {
   _prepare_header(&p->header, cmd, p->len);
   for (int i = 0; i < sizeof(p->header); i++) {
     DEBUG_PRINTF("0x%x ", *((uint8_t *)&p->header + i));
@@ -143,77 +202,297 @@ DGUS_RETURN send_data(enum command cmd, dgus_packet *p) {
   DEBUG_PRINTF("\n");
   if (_ser_send_handler)
     _ser_send_handler((uint8_t *)p, sizeof(p->header) + p->len);
+#if CAPTURE_ENABLED
+  dgus_capture_record(0, (uint8_t *)p, sizeof(p->header) + p->len);
+#endif
+  dgus_tx_account(sizeof(p->header) + p->len);
+
+  // remember which read this is, so an auto upload arriving first is not taken as its reply
+  _expect_read = cmd == DGUS_CMD_VAR_R && p->len >= 3;
+  if (_expect_read) {
+    _expect_addr = ((uint16_t)p->data.cdata[0] << 8) | p->data.cdata[1];
+    _expect_words = p->data.cdata[2];
+  }
+}
+
+static DGUS_RETURN _transmit(enum command cmd, dgus_packet *p) {
+  _transmit_raw(cmd, p);
 
   if (cmd != DGUS_CMD_VAR_R)
-    if (_polling_wait_for_ok() == DGUS_TIMEOUT);
+    if (_polling_wait_for_ok() == DGUS_TIMEOUT)
       return DGUS_TIMEOUT;
 
   return DGUS_OK;
 }
 
-int dgus_recv_data() {
-  static int recv_cnt = 0;
-  static uint8_t _recv_state = 0;
+DGUS_RETURN send_data(enum command cmd, dgus_packet *p) {
+  // VPs of a page that is not showing can wait until it is
+  if (cmd == DGUS_CMD_VAR_W && dgus_page_defer_write(p->data.cdata, p->len))
+    return DGUS_OK;
+
+  // normal and bulk writes may be held back to keep the link free for touch feedback
+  if (dgus_tx_enqueue(cmd, p->data.cdata, p->len))
+    return DGUS_OK;
+
+  return _transmit(cmd, p);
+}
+
+DGUS_RETURN dgus_send_frame(enum command cmd, const uint8_t *data, uint8_t len) {
+  // private packet, the shared one may be mid-build by the caller
+  dgus_packet d;
 
+  if (len > SEND_BUFFER_SIZE)
+    return DGUS_ERROR;
+
+  memcpy(d.data.cdata, data, len);
+  d.len = len;
+  return _transmit(cmd, &d);
+}
+
+DGUS_RETURN dgus_send_frame_nowait(enum command cmd, const uint8_t *data, uint8_t len) {
+  dgus_packet d;
+
+  if (len > SEND_BUFFER_SIZE)
+    return DGUS_ERROR;
+
+  memcpy(d.data.cdata, data, len);
+  d.len = len;
+  _transmit_raw(cmd, &d);
+  return DGUS_OK;
+}
+
+int dgus_recv_data() {
   if (!_ser_avail_handler || ! _ser_recv_handler)
     return -1;
-  
-  //_delay(10);
-  while (_ser_avail_handler())
-  {
-      uint8_t d = _ser_recv_handler();
-
-      if (_recv_state == 0) {
-        memset(recvdata, 0, sizeof(recvdata));
-          recvlen = 0;
-          recvcmd = 0;
-        // match first header byte
-        if (d != HEADER0) {
-          recv_cnt = 0;
-          return -1;
-        }
-
-        _recv_state = 1;
-      }
-      else if (_recv_state == 1) {
-        // match second header byte or 0 for an OK message
-        if (d != HEADER1 && d != 0) {
-          recv_cnt = 0;
-          _recv_state = 0;
-          return -1;
-        }
-
-        _recv_state = 2;
-      }
-      // Len. We got the header. next up if length
-      else if (_recv_state == 2) {
-        recvlen = d;
-        _recv_state = 3;
-      }
-      // command byte
-      else if (_recv_state == 3) {
-        recvcmd = d;
-        _recv_state = 4;
-      }
-      // data payload next
-      else if (_recv_state == 4) {
-        recvdata[recv_cnt] = d;
-        recv_cnt++;
-
-        if (recv_cnt >= recvlen - 1) {
-          // done
-          int res = _handle_packet(recvdata, recvcmd, recvlen - 1);
-          
-          _recv_state = 0;
-          recv_cnt = 0;
-          return res;
-        }
-      }
+
+  int r = _recv_parse();
+
+#if EVENT_QUEUE_ENTRIES
+  // take the whole burst so repeats can be coalesced
+  for (int n = r; n != 0; )
+    n = _recv_parse();
+#endif
+
+  // the main loop is the only place handlers run, never inside a blocking send
+  dgus_process_events();
+  return r;
+}
+
+#if EVENT_QUEUE_ENTRIES
+/* Queue a parsed packet. Returns 0 if it was dropped */
+static uint8_t _event_push(char *data, uint8_t cmd, uint8_t len, uint16_t addr, uint8_t bytelen) {
+  uint8_t size = cmd == DGUS_CMD_VAR_R ? bytelen * 2 : bytelen;
+  if (size > RECV_BUFFER_SIZE)
+    size = RECV_BUFFER_SIZE;
+
+  // a repeat of the newest upload before it was handled says nothing new
+  if (_event_count) {
+    dgus_event *e = &_events[(_event_head + _event_count - 1) % EVENT_QUEUE_ENTRIES];
+    if (e->cmd == cmd && e->addr == addr && e->bytelen == bytelen && memcmp(e->data, data, size) == 0)
+      return 1;
   }
 
+  if (_event_count >= EVENT_QUEUE_ENTRIES) {
+    _events_dropped++;
+    return 0;
+  }
+
+  dgus_event *e = &_events[(_event_head + _event_count) % EVENT_QUEUE_ENTRIES];
+  e->cmd = cmd;
+  e->len = len;
+  e->addr = addr;
+  e->bytelen = bytelen;
+  memcpy(e->data, data, size);
+  _event_count++;
+  return 1;
+}
+
+uint8_t dgus_process_events() {
+  uint8_t n = 0;
+
+  // a handler calling dgus_recv_data() must not run the queue again
+  if (_events_draining)
+    return 0;
+
+  _events_draining = 1;
+  while (_event_count) {
+    dgus_event e = _events[_event_head];
+    _event_head = (_event_head + 1) % EVENT_QUEUE_ENTRIES;
+    _event_count--;
+
+    if (_recv_handler)
+      _recv_handler(e.data, e.cmd, e.len, e.addr, e.bytelen);
+    n++;
+  }
+  _events_draining = 0;
+
+  return n;
+}
+
+uint16_t dgus_events_dropped() {
+  return _events_dropped;
+}
+#else
+uint8_t dgus_process_events() {
   return 0;
 }
 
+uint16_t dgus_events_dropped() {
+  return 0;
+}
+#endif
+
+/* Check a frame header. Returns the frame length, 0 if it is not a frame */
+static uint8_t _frame_check(const uint8_t *f) {
+  uint8_t len = f[2];
+
+  // second header byte, or 0 as some firmware sends ahead of an OK
+  if (f[1] != HEADER1 && f[1] != 0)
+    return 0;
+  if (len < 2 || len - 1 > RECV_BUFFER_SIZE)
+    return 0;
+  if (f[3] < DGUS_CMD_REG_W || f[3] > DGUS_CMD_VAR_R)
+    return 0;
+
+  return len + 3;
+}
+
+/* The payload must agree with the counts it carries */
+static uint8_t _frame_payload_ok(uint8_t cmd, const uint8_t *data, uint8_t len) {
+  if (cmd == DGUS_CMD_VAR_W || cmd == DGUS_CMD_REG_W)
+    return len == 2 && data[0] == 'O' && data[1] == 'K';
+  if (cmd == DGUS_CMD_VAR_R)
+    return len >= 3 && len == 3 + data[2] * 2;
+  return len >= 2 && len == 2 + data[1];
+}
+
+/* Check a frame the host sent. Returns the frame length, 0 if it is not a frame */
+static uint8_t _frame_check_sent(const uint8_t *f) {
+  uint8_t len = f[2];
+
+  if (f[1] != HEADER1)
+    return 0;
+  if (len < 2 || len - 1 > SEND_BUFFER_SIZE)
+    return 0;
+  if (f[3] < DGUS_CMD_REG_W || f[3] > DGUS_CMD_CURVE_W)
+    return 0;
+
+  return len + 3;
+}
+
+/* Sent payloads carry an address, and a read carries only the address and count */
+static uint8_t _frame_payload_sent_ok(uint8_t cmd, uint8_t len) {
+  if (cmd == DGUS_CMD_VAR_W)
+    return len >= 3;
+  if (cmd == DGUS_CMD_VAR_R)
+    return len == 3;
+  if (cmd == DGUS_CMD_REG_R)
+    return len == 2;
+  return len >= 1;
+}
+
+static uint8_t _frame_scan(const uint8_t *buf, size_t len, size_t *used, dgus_frame *frame, uint8_t sent) {
+  size_t pos = 0;
+
+  while (pos < len) {
+    const uint8_t *h = memchr(buf + pos, HEADER0, len - pos);
+    if (!h) {
+      pos = len;
+      break;
+    }
+    pos = h - buf;
+
+    // wait for the rest of the header
+    if (len - pos < 4)
+      break;
+
+    uint8_t flen = sent ? _frame_check_sent(h) : _frame_check(h);
+    if (!flen) {
+      pos++;
+      continue;
+    }
+    if (len - pos < flen)
+      break;
+    if (sent ? !_frame_payload_sent_ok(h[3], flen - 4) : !_frame_payload_ok(h[3], h + 4, flen - 4)) {
+      pos++;
+      continue;
+    }
+
+    frame->cmd = h[3];
+    frame->len = flen - 4;
+    frame->data = h + 4;
+    *used = pos + flen;
+    return 1;
+  }
+
+  *used = pos;
+  return 0;
+}
+
+uint8_t dgus_frame_scan(const uint8_t *buf, size_t len, size_t *used, dgus_frame *frame) {
+  return _frame_scan(buf, len, used, frame, 0);
+}
+
+uint8_t dgus_frame_scan_sent(const uint8_t *buf, size_t len, size_t *used, dgus_frame *frame) {
+  return _frame_scan(buf, len, used, frame, 1);
+}
+
+/* Pull what the port has into the staging buffer */
+static void _recv_fill() {
+#if CAPTURE_ENABLED
+  size_t before = _stage_len;
+#endif
+
+  if (_ser_read_handler) {
+    _stage_len += _ser_read_handler(&_stage[_stage_len], sizeof(_stage) - _stage_len);
+  }
+  else {
+    while (_stage_len < sizeof(_stage) && _ser_avail_handler())
+      _stage[_stage_len++] = _ser_recv_handler();
+  }
+
+#if CAPTURE_ENABLED
+  if (_stage_len != before)
+    dgus_capture_record(CAPTURE_TAG_RX, &_stage[before], _stage_len - before);
+#endif
+}
+
+static int _recv_parse() {
+  dgus_frame f;
+  size_t used;
+  uint8_t found;
+
+  if (!_ser_avail_handler || ! _ser_recv_handler)
+    return -1;
+
+  // keep going through noise while the port has more, rather than waiting for the next call
+  do {
+    _recv_fill();
+
+    found = dgus_frame_scan(_stage, _stage_len, &used, &f);
+    if (!found) {
+      _recv_discarded += used;
+      // a full buffer with no frame start left in it can only be noise
+      if (used == 0 && _stage_len == sizeof(_stage))
+        used = 1;
+    }
+    else {
+      _recv_discarded += used - f.len - 4;
+      recvcmd = f.cmd;
+      recvlen = f.len + 1;
+      memcpy(recvdata, f.data, f.len);
+    }
+
+    memmove(_stage, &_stage[used], _stage_len - used);
+    _stage_len -= used;
+  } while (!found && used && _ser_avail_handler());
+
+  if (!found)
+    return 0;
+
+  return _handle_packet((char *)recvdata, recvcmd, recvlen - 1);
+}
+
 /* tail n 8 bit variable to the output buffer */
 void buffer_u8(dgus_packet *p, uint8_t *data, size_t len) {
   memcpy(&p->data.cdata[p->len], data, len);
@@ -251,23 +530,54 @@ void buffer_u32_1(dgus_packet *p, uint32_t data) {
   }
 }
 
+/* Only the header and length need resetting, bytes past len are never sent */
+static void _packet_reset(dgus_packet *p) {
+  memset(&p->header, 0, sizeof(p->header));
+  p->len = 0;
+}
+
 /* re-init the packet buffer */
 dgus_packet *dgus_packet_init() {
   static dgus_packet d;
-  memset(&d, 0, sizeof(d));
-  d.len = 0;
+  _packet_reset(&d);
   return &d;
 }
 
+dgus_packet *dgus_packet_acquire() {
+  for (uint8_t i = 0; i < PACKET_POOL_SIZE; i++) {
+    if (!_packet_used[i]) {
+      _packet_used[i] = 1;
+      _packet_reset(&_packet_pool[i]);
+      return &_packet_pool[i];
+    }
+  }
+  return NULL;
+}
+
+void dgus_packet_release(dgus_packet *p) {
+  if (p >= _packet_pool && p < &_packet_pool[PACKET_POOL_SIZE])
+    _packet_used[p - _packet_pool] = 0;
+}
+
+DGUS_RETURN dgus_packet_send(enum command cmd, dgus_packet *p) {
+  DGUS_RETURN r = send_data(cmd, p);
+  dgus_packet_release(p);
+  return r;
+}
+
 void dgus_packet_set_data(dgus_packet *p, uint8_t offset, uint8_t *data, uint8_t len) {
     memcpy(&p->data.cdata[offset], data, len);
 }
 
 DGUS_RETURN dgus_request_var(uint16_t addr, uint8_t len) {
-  dgus_packet *d = dgus_packet_init();
+  dgus_packet *d = dgus_packet_acquire();
+  if (!d)
+    return DGUS_PACKET_POOL_EMPTY;
   buffer_u16(d, &addr, 1);
   buffer_u8(d, &len, 1);
-  send_data(DGUS_CMD_VAR_R, d);
+  dgus_packet_send(DGUS_CMD_VAR_R, d);
+  // nobody waits, the reply goes to the packet handler
+  _expect_read = 0;
 
   // async wait for reply
   return DGUS_OK;
@@ -275,10 +585,12 @@ DGUS_RETURN dgus_request_var(uint16_t addr, uint8_t len) {
 
 /* Sync read n 16 bit variables from the VAR register at addr */
 DGUS_RETURN dgus_get_var8(uint16_t addr, uint8_t *buf, uint8_t len) {
-  dgus_packet *d = dgus_packet_init();
+  dgus_packet *d = dgus_packet_acquire();
+  if (!d)
+    return DGUS_PACKET_POOL_EMPTY;
   buffer_u16(d, &addr, 1);
   buffer_u8(d, &len, 1);
-  send_data(DGUS_CMD_VAR_R, d);
+  dgus_packet_send(DGUS_CMD_VAR_R, d);
 
   DGUS_RETURN r =_polling_wait();
   if (r != DGUS_OK) return r;
@@ -294,16 +606,18 @@ DGUS_RETURN dgus_get_var8(uint16_t addr, uint8_t *buf, uint8_t len) {
 }
 
 DGUS_RETURN dgus_get_var(uint16_t addr, uint16_t *buf, uint8_t len) {
-  dgus_packet *d = dgus_packet_init();
+  dgus_packet *d = dgus_packet_acquire();
+  if (!d)
+    return DGUS_PACKET_POOL_EMPTY;
   buffer_u16(d, &addr, 1);
   buffer_u8(d, &len, 1);
-  send_data(DGUS_CMD_VAR_R, d);
+  dgus_packet_send(DGUS_CMD_VAR_R, d);
 
   DGUS_RETURN r =_polling_wait();
   if (r != DGUS_OK) return r;
 
-  // got a packet
-  memcpy(buf, (uint16_t *)recvdata, len);
+  // got a packet. len is in words
+  memcpy(buf, (uint16_t *)recvdata, len * 2);
   
   return DGUS_OK;
 }
@@ -313,32 +627,40 @@ DGUS_RETURN dgus_get_var(uint16_t addr, uint16_t *buf, uint8_t len) {
  * data width is 16 bit
  */
 DGUS_RETURN dgus_set_var(uint16_t addr, uint32_t data) {
-  dgus_packet *d = dgus_packet_init();
+  dgus_packet *d = dgus_packet_acquire();
+  if (!d)
+    return DGUS_PACKET_POOL_EMPTY;
   buffer_u16(d, &addr, 1);
   buffer_u32_1(d, (data));
-  return send_data(DGUS_CMD_VAR_W, d);
+  return dgus_packet_send(DGUS_CMD_VAR_W, d);
 }
 
 DGUS_RETURN dgus_set_var8(uint16_t addr, uint8_t *data, uint8_t len) {
-  dgus_packet *d = dgus_packet_init();
+  dgus_packet *d = dgus_packet_acquire();
+  if (!d)
+    return DGUS_PACKET_POOL_EMPTY;
   buffer_u16(d, &addr, 1);
   buffer_u8(d, data, len);
-  return send_data(DGUS_CMD_VAR_W, d);
+  return dgus_packet_send(DGUS_CMD_VAR_W, d);
 }
 
 DGUS_RETURN dgus_set_cmd(uint16_t addr, uint8_t *data, uint8_t len) {
-  dgus_packet *d = dgus_packet_init();
+  dgus_packet *d = dgus_packet_acquire();
+  if (!d)
+    return DGUS_PACKET_POOL_EMPTY;
   buffer_u16(d, &addr, 1);
   buffer_u8(d, data, len);
-  return send_data(DGUS_CMD_REG_R, d);
+  return dgus_packet_send(DGUS_CMD_REG_R, d);
 }
 
 DGUS_RETURN dgus_get_cmd(uint16_t addr, uint8_t *data, uint8_t len) {
-  dgus_packet *d = dgus_packet_init();
+  dgus_packet *d = dgus_packet_acquire();
+  if (!d)
+    return DGUS_PACKET_POOL_EMPTY;
   buffer_u16(d, &addr, 1);
   buffer_u8(d, data, len);
   
-  send_data(DGUS_CMD_REG_W, d);
+  dgus_packet_send(DGUS_CMD_REG_W, d);
 
   DGUS_RETURN r =_polling_wait();
   if (r != DGUS_OK) return r;
@@ -356,6 +678,52 @@ void dgus_packet_set_len(dgus_packet *p, uint16_t len) {
   p->len = len;
 }
 
+uint8_t *dgus_packet_reserve(dgus_packet *p, uint8_t len) {
+  if (p->len + len > SEND_BUFFER_SIZE)
+    return NULL;
+
+  uint8_t *r = &p->data.cdata[p->len];
+  p->len += len;
+  return r;
+}
+
+void dgus_set_baud_handler(ser_baud_handler_cb handler, uint32_t baud) {
+  _ser_baud_handler = handler;
+  _ser_baud = baud;
+}
+
+uint32_t dgus_get_host_baud() {
+  return _ser_baud;
+}
+
+DGUS_RETURN dgus_set_host_baud(uint32_t baud) {
+  if (!_ser_baud_handler)
+    return DGUS_ERROR;
+  if (_ser_baud_handler(baud) != DGUS_OK)
+    return DGUS_ERROR;
+
+  _ser_baud = baud;
+  dgus_recv_reset();
+  return DGUS_OK;
+}
+
+void dgus_recv_reset() {
+  // whatever is buffered was framed at the old rate
+  if (_ser_avail_handler && _ser_recv_handler) {
+    while (_ser_avail_handler())
+      _ser_recv_handler();
+  }
+  _stage_len = 0;
+}
+
+void dgus_set_read_handler(ser_read_handler_cb read) {
+  _ser_read_handler = read;
+}
+
+uint32_t dgus_recv_discarded() {
+  return _recv_discarded;
+}
+
 uint8_t *dgus_packet_get_recv_buffer() {
   return recvdata;
 }
@@ -387,11 +755,19 @@ static int _handle_packet(char *data, uint8_t cmd, uint8_t len) {
   else if(cmd == DGUS_CMD_VAR_R) {
     addr = SWP16(*(uint16_t *)data);
     bytelen = data[2];
+    recvaddr = addr;
+    recvwords = bytelen;
 
     for(unsigned long i = 0; i < bytelen * 2; i += 2) {
       data[i] = data[4 + i];
       data[i + 1] = data[3 + i];
     }
+
+    // the reply _polling_wait() is after belongs to the caller, not the upload handler
+    if (_expect_read && addr == _expect_addr && bytelen == _expect_words) {
+      _expect_read = 0;
+      return bytelen;
+    }
   }
   else if(cmd == DGUS_CMD_REG_R) {
     // response for reading the page from the register
@@ -409,8 +785,12 @@ static int _handle_packet(char *data, uint8_t cmd, uint8_t len) {
   }
   DEBUG_PRINTF("\n");
 
+#if EVENT_QUEUE_ENTRIES
+  _event_push(data, cmd, len, addr, bytelen);
+#else
   if (_recv_handler) 
     _recv_handler(data, cmd, len, addr, bytelen);
+#endif
 
   return bytelen;
 }
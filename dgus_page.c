@@ -0,0 +1,289 @@
+/**
+ * @file dgus_page.c
+ * @author Barry Carter
+ * @date 01 Jan 2021
+ * @brief DGUS II LCD Page profiles
+ */
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "dgus.h"
+#include "dgus_page.h"
+
+#define PAGE_FRAME_WORDS ((SEND_BUFFER_SIZE - 2) / 2)   /**< VP words that fit one write frame */
+
+typedef struct page_profile_entry_t {
+  uint8_t page;
+  uint8_t words;
+  uint16_t vp;
+  dgus_page_source_cb source;
+  void *ctx;
+} page_profile_entry; /**< One VP on a page and its data source */
+
+typedef struct page_map_entry_t {
+  uint8_t page;
+  uint16_t vp;
+  uint16_t words;
+  uint16_t shadow;              /**< first word of the range in the shadow */
+} page_map_entry; /**< A VP range shown only on one page */
+
+/* Kept sorted by page then vp so a page is one run of adjacent VPs */
+static page_profile_entry _profiles[PAGE_PROFILE_ENTRIES];
+static uint16_t _profile_count;
+
+/* Lazy updates. Kept sorted by vp for lookup */
+static page_map_entry _maps[PAGE_MAP_ENTRIES];
+static uint16_t _map_count;
+static uint16_t _shadow[PAGE_SHADOW_WORDS];              /**< deferred values, host byte order */
+static uint8_t _shadow_dirty[(PAGE_SHADOW_WORDS + 7) / 8];
+static uint16_t _shadow_used;
+static uint8_t _lazy;
+static uint8_t _cur_page;
+static uint8_t _cur_page_known;
+
+static int _profile_cmp(uint8_t page, uint16_t vp, page_profile_entry *e) {
+  if (page != e->page)
+    return page < e->page ? -1 : 1;
+  if (vp != e->vp)
+    return vp < e->vp ? -1 : 1;
+  return 0;
+}
+
+static DGUS_RETURN _page_write(uint16_t vp, uint16_t *data, uint8_t words) {
+  dgus_packet *d = dgus_packet_acquire();
+  if (!d)
+    return DGUS_PACKET_POOL_EMPTY;
+  buffer_u16(d, &vp, 1);
+  buffer_u16(d, data, words);
+  return dgus_packet_send(DGUS_CMD_VAR_W, d);
+}
+
+DGUS_RETURN dgus_page_profile_add(uint8_t page, uint16_t vp, uint8_t words, dgus_page_source_cb source, void *ctx) {
+  uint16_t i = 0;
+
+  if (words == 0 || words > PAGE_FRAME_WORDS)
+    return DGUS_ERROR;
+
+  while (i < _profile_count && _profile_cmp(page, vp, &_profiles[i]) > 0)
+    i++;
+
+  // re-registering a VP replaces its source
+  if (i < _profile_count && _profile_cmp(page, vp, &_profiles[i]) == 0) {
+    _profiles[i].words = words;
+    _profiles[i].source = source;
+    _profiles[i].ctx = ctx;
+    return DGUS_OK;
+  }
+
+  if (_profile_count >= PAGE_PROFILE_ENTRIES)
+    return DGUS_PAGE_TABLE_FULL;
+
+  memmove(&_profiles[i + 1], &_profiles[i], sizeof(page_profile_entry) * (_profile_count - i));
+  _profiles[i].page = page;
+  _profiles[i].vp = vp;
+  _profiles[i].words = words;
+  _profiles[i].source = source;
+  _profiles[i].ctx = ctx;
+  _profile_count++;
+
+  return DGUS_OK;
+}
+
+void dgus_page_profile_clear(uint8_t page) {
+  uint16_t o = 0;
+
+  for (uint16_t i = 0; i < _profile_count; i++) {
+    if (_profiles[i].page != page)
+      _profiles[o++] = _profiles[i];
+  }
+  _profile_count = o;
+}
+
+DGUS_RETURN dgus_page_preload(uint8_t page) {
+  DGUS_RETURN r = DGUS_OK;
+  uint16_t buf[PAGE_FRAME_WORDS];
+  uint16_t start = 0;
+  uint8_t used = 0;
+
+  for (uint16_t i = 0; i < _profile_count; i++) {
+    page_profile_entry *e = &_profiles[i];
+    if (e->page != page)
+      continue;
+
+    // flush when this VP does not continue the frame or does not fit it
+    if (used && (e->vp != start + used || used + e->words > PAGE_FRAME_WORDS)) {
+      if (_page_write(start, buf, used) != DGUS_OK)
+        r = DGUS_TIMEOUT;
+      used = 0;
+    }
+
+    uint8_t n = e->source(e->vp, &buf[used], e->words, e->ctx);
+    if (n > e->words)
+      n = e->words;
+    if (n == 0)
+      continue;
+
+    if (used == 0)
+      start = e->vp;
+    used += n;
+
+    // a short value leaves a hole, so nothing can follow it in this frame
+    if (n < e->words) {
+      if (_page_write(start, buf, used) != DGUS_OK)
+        r = DGUS_TIMEOUT;
+      used = 0;
+    }
+  }
+
+  if (used && _page_write(start, buf, used) != DGUS_OK)
+    r = DGUS_TIMEOUT;
+
+  return r;
+}
+
+/* Lazy updates */
+
+DGUS_RETURN dgus_page_map_vp(uint8_t page, uint16_t vp, uint16_t words) {
+  uint16_t i = 0;
+
+  if (words == 0)
+    return DGUS_ERROR;
+  if (_map_count >= PAGE_MAP_ENTRIES || _shadow_used + words > PAGE_SHADOW_WORDS)
+    return DGUS_PAGE_TABLE_FULL;
+
+  while (i < _map_count && _maps[i].vp < vp)
+    i++;
+
+  // ranges must not overlap
+  if (i > 0 && _maps[i - 1].vp + _maps[i - 1].words > vp)
+    return DGUS_ERROR;
+  if (i < _map_count && vp + words > _maps[i].vp)
+    return DGUS_ERROR;
+
+  memmove(&_maps[i + 1], &_maps[i], sizeof(page_map_entry) * (_map_count - i));
+  _maps[i].page = page;
+  _maps[i].vp = vp;
+  _maps[i].words = words;
+  _maps[i].shadow = _shadow_used;
+  _shadow_used += words;
+  _map_count++;
+
+  return DGUS_OK;
+}
+
+void dgus_page_set_lazy(uint8_t enabled) {
+  _lazy = enabled;
+}
+
+void dgus_page_set_current(uint8_t page) {
+  _cur_page = page;
+  _cur_page_known = 1;
+}
+
+static int _dirty(uint16_t w) {
+  return _shadow_dirty[w / 8] & (1 << (w % 8));
+}
+
+static void _set_dirty(uint16_t w, uint8_t dirty) {
+  if (dirty)
+    _shadow_dirty[w / 8] |= 1 << (w % 8);
+  else
+    _shadow_dirty[w / 8] &= ~(1 << (w % 8));
+}
+
+/* Last map entry starting at or before vp, or NULL */
+static page_map_entry *_map_find(uint16_t vp) {
+  int lo = 0, hi = _map_count - 1;
+  page_map_entry *r = NULL;
+
+  while (lo <= hi) {
+    int mid = (lo + hi) / 2;
+    if (_maps[mid].vp <= vp) {
+      r = &_maps[mid];
+      lo = mid + 1;
+    }
+    else {
+      hi = mid - 1;
+    }
+  }
+  return r;
+}
+
+/* A write is going out, so anything deferred for those words is stale */
+static void _clear_dirty(uint16_t vp, uint16_t words) {
+  page_map_entry *e = _map_find(vp);
+  page_map_entry *end = &_maps[_map_count];
+
+  if (!e)
+    e = _maps;
+  for (; e < end && e->vp < vp + words; e++) {
+    for (uint16_t w = 0; w < e->words; w++) {
+      if (e->vp + w >= vp && e->vp + w < vp + words)
+        _set_dirty(e->shadow + w, 0);
+    }
+  }
+}
+
+uint8_t dgus_page_defer_write(const uint8_t *data, uint8_t len) {
+  // a single byte write still invalidates its word below, like any odd write
+  if (_map_count == 0 || len < 3)
+    return 0;
+
+  uint16_t vp = ((uint16_t)data[0] << 8) | data[1];
+  uint16_t words = (len - 2) / 2;
+  page_map_entry *e = _map_find(vp);
+
+  // odd writes only touch half a word, the other half is unknown here
+  int deferrable = _lazy && _cur_page_known && (len & 1) == 0 &&
+                   e && vp + words <= e->vp + e->words && e->page != _cur_page;
+
+  if (!deferrable) {
+    _clear_dirty(vp, (len - 1) / 2);
+    return 0;
+  }
+
+  uint16_t w0 = e->shadow + (vp - e->vp);
+  for (uint16_t i = 0; i < words; i++) {
+    _shadow[w0 + i] = ((uint16_t)data[2 + i * 2] << 8) | data[3 + i * 2];
+    _set_dirty(w0 + i, 1);
+  }
+  return 1;
+}
+
+DGUS_RETURN dgus_page_flush(uint8_t page) {
+  DGUS_RETURN r = DGUS_OK;
+  uint16_t buf[PAGE_FRAME_WORDS];
+  uint16_t start = 0;
+  uint8_t used = 0;
+
+  for (uint16_t i = 0; i < _map_count; i++) {
+    page_map_entry *e = &_maps[i];
+    if (e->page != page)
+      continue;
+
+    for (uint16_t w = 0; w < e->words; w++) {
+      uint16_t vp = e->vp + w;
+
+      // a clean word or a full frame ends the run
+      if (used && (!_dirty(e->shadow + w) || vp != start + used || used == PAGE_FRAME_WORDS)) {
+        if (_page_write(start, buf, used) != DGUS_OK)
+          r = DGUS_TIMEOUT;
+        used = 0;
+      }
+      if (!_dirty(e->shadow + w))
+        continue;
+
+      if (used == 0)
+        start = vp;
+      buf[used++] = _shadow[e->shadow + w];
+      _set_dirty(e->shadow + w, 0);
+    }
+  }
+
+  if (used && _page_write(start, buf, used) != DGUS_OK)
+    r = DGUS_TIMEOUT;
+
+  return r;
+}
@@ -0,0 +1,101 @@
+#pragma once
+/**
+ * @file dgus_page.h
+ * @author Barry Carter
+ * @date 01 Jan 2021
+ * @brief DGUS II LCD Page profiles
+ */
+#include <stddef.h>
+#include <stdint.h>
+#include "dgus_reg.h"
+#include "dgus.h"
+
+/**
+ * @brief Data source for a VP shown on a page. Fill @p buf with the current value
+ *
+ * @param vp VP address being loaded
+ * @param buf words to fill, host byte order
+ * @param words number of words registered for the VP
+ * @param ctx context given to dgus_page_profile_add()
+ * @return uint8_t words filled. 0 to skip the VP this time
+ */
+typedef uint8_t (*dgus_page_source_cb)(uint16_t vp, uint16_t *buf, uint8_t words, void *ctx);
+
+/**
+ * @brief Register a VP shown on @p page and where its value comes from
+ * All VPs registered for a page are pushed by dgus_set_page() before the page is flipped,
+ * coalescing adjacent VPs into shared frames.
+ *
+ * @param page page id
+ * @param vp VP address
+ * @param words number of words the VP holds
+ * @param source callback producing the value
+ * @param ctx passed to @p source
+ * @return #DGUS_RETURN #DGUS_PAGE_TABLE_FULL when PAGE_PROFILE_ENTRIES is reached
+ */
+DGUS_RETURN dgus_page_profile_add(uint8_t page, uint16_t vp, uint8_t words, dgus_page_source_cb source, void *ctx);
+
+/**
+ * @brief Remove every VP registered for a page
+ *
+ * @param page page id
+ */
+void dgus_page_profile_clear(uint8_t page);
+
+/**
+ * @brief Push all registered values for a page in coalesced frames
+ * Called by dgus_set_page(). Call it directly to refresh the page that is already showing.
+ *
+ * @param page page id
+ * @return #DGUS_RETURN
+ */
+DGUS_RETURN dgus_page_preload(uint8_t page);
+
+/**
+ * @brief Map a VP range to the page that shows it, for lazy updates
+ * While lazy updates are enabled, writes that fall entirely inside a range mapped to a page
+ * other than the current one are kept in a host shadow and sent when that page is entered.
+ * @note a VP shown on several pages should not be mapped
+ *
+ * @param page page id
+ * @param vp first VP address
+ * @param words number of words in the range
+ * @return #DGUS_RETURN #DGUS_PAGE_TABLE_FULL when PAGE_MAP_ENTRIES or PAGE_SHADOW_WORDS is reached,
+ * #DGUS_ERROR if the range overlaps an existing one
+ */
+DGUS_RETURN dgus_page_map_vp(uint8_t page, uint16_t vp, uint16_t words);
+
+/**
+ * @brief Enable or disable lazy updates of VPs mapped to off-screen pages
+ * Disabling sends nothing; deferred values wait until their page is entered.
+ *
+ * @param enabled 1 to defer off-screen writes
+ */
+void dgus_page_set_lazy(uint8_t enabled);
+
+/**
+ * @brief Tell the library which page is showing
+ * dgus_set_page() and dgus_get_page() keep this up to date. Call it when the panel
+ * changes page on its own, e.g. from a touch key, then call dgus_page_flush().
+ *
+ * @param page page id
+ */
+void dgus_page_set_current(uint8_t page);
+
+/**
+ * @brief Send every deferred value for a page in coalesced frames
+ *
+ * @param page page id
+ * @return #DGUS_RETURN
+ */
+DGUS_RETURN dgus_page_flush(uint8_t page);
+
+/* internal */
+/**
+ * @brief Offer a VAR write frame to the lazy update shadow. Called from send_data()
+ *
+ * @param data frame payload, VP address first
+ * @param len payload length in bytes
+ * @return uint8_t 1 if the write was deferred and must not be sent
+ */
+uint8_t dgus_page_defer_write(const uint8_t *data, uint8_t len);
@@ -9,6 +9,7 @@
 
 
 #define member_size(type, member) sizeof(((type *)0)->member)  /**< Get the member size of a struct */
+#define member_word(type, member) (offsetof(type, member) / 2)   /**< VP word offset of a member in an SP struct */
 #define SWP16(pt) (pt>>8) | (pt<<8)                            /**< Swap XY bytes to be YX */
 #define SWP32(i) ((i&0xff000000)>>24)| ((i&0xff0000)>>8) | ((i&0xff00)<<8) | ((i&0xff)<<24) /**< Swap all bytes in a u32 to be le order */
 
@@ -17,6 +18,8 @@
 #define	PIC_SET_PAGE_BASE    ((unsigned long)0x5A010000)  /**< Base address of the page change */
 #define	DGUS_RESET           ((unsigned long)0x55AA5AA5)  /**< Magic reset command for the T5 */
 #define	DGUS_RESET_HARD      ((unsigned long)0x55AA5A5A) /**< Magic reset command for the T5 and all onboard periphs */
+#define	DGUS_BAUD_CLOCK      ((unsigned long)3225600)    /**< UART2 rate = DGUS_BAUD_CLOCK / divisor */
+#define	DGUS_BAUD_ENABLE     0x5A                        /**< First byte of a UART2 rate change */
 
 /* Command addresses. A REG is 8bit, VAR cmd typically 16 */
 /**
@@ -40,6 +43,24 @@ enum command {
 #define DGUS_ERROR                    2   /**< Unspecified serious error */
 #define DGUS_CURVE_BUFFER_FULL        10  /**< Cannot append any more data to this buffer */
 #define DGUS_CURVE_CHANNEL_NOT_FOUND  11  /**< The Curve channel 0-7 was not initialised or found */
+#define DGUS_TEXT_ENCODING_UNSUPPORTED 20 /**< No transcoder for the text control's encode mode */
+#define DGUS_SP_TYPE_UNKNOWN          30  /**< Not a control type in the SP descriptor table */
+#define DGUS_PAGE_TABLE_FULL          40  /**< No room left in the page profile table */
+#define DGUS_DISPATCH_TABLE_FULL      50  /**< No room left in the dispatch table */
+#define DGUS_BAUD_UNSUPPORTED         60  /**< The panel cannot run within 2% of the requested rate */
+#define DGUS_BAUD_FALLBACK            61  /**< The new rate failed its check, both ends are back on the old one */
+#define DGUS_FLASH_RANGE              70  /**< Flash address or length out of range or not even */
+#define DGUS_FLASH_BUSY               71  /**< The flash copy did not complete in time */
+#define DGUS_KV_NOT_FOUND             80  /**< No such key in the key-value store */
+#define DGUS_KV_FULL                  81  /**< Key-value index or flash region is full */
+#define DGUS_KV_CORRUPT               82  /**< Stored value failed its checksum */
+#define DGUS_UPLOAD_VERIFY            90  /**< A staged block kept failing the panel's CRC check */
+#define DGUS_JPEG_TOO_LARGE           100 /**< The JPEG does not fit a staging slot */
+#define DGUS_AUDIO_RATE               110 /**< The link cannot carry the audio byte rate */
+#define DGUS_GRAPHIC_FULL             120 /**< The display list has no room for the primitive */
+#define DGUS_PACKET_POOL_EMPTY        130 /**< Every packet buffer is in use */
+#define DGUS_WATCH_TABLE_FULL         140 /**< WATCH_MAX_ENTRIES VP ranges are already watched */
+#define DGUS_NO_MEMORY                150 /**< dgus_calloc() could not supply the memory, e.g. the static pool ran out */
 
 
 /**
@@ -52,6 +73,7 @@ enum dgus_cmd_reg { // word sized registers
   OsUpdateCmd = 0x06,
   NorFlashRWCmd = 0x08,
   Reserved0C = 0x0C,
+  Uart2Baud = 0x0C,             // 0x5A, 0x00, divisor = 3225600 / baud. Not kept over a reset
   Ver = 0x0F,
   Rtc = 0x10,
   PicPage = 0x14,
@@ -0,0 +1,226 @@
+/**
+ * @file dgus_tx.c
+ * @author Barry Carter
+ * @date 01 Jan 2021
+ * @brief DGUS II LCD Outbound traffic scheduler
+ */
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+#include "dgus.h"
+#include "dgus_tx.h"
+
+#define TX_FRAME_OVERHEAD 4     /**< 5A A5 len cmd */
+
+typedef struct tx_frame_t {
+  uint8_t cmd;
+  uint8_t len;
+  uint8_t data[SEND_BUFFER_SIZE];
+} tx_frame; /**< A write waiting for the link */
+
+typedef struct tx_queue_t {
+  tx_frame frames[TX_QUEUE_FRAMES];
+  uint8_t head;
+  uint8_t count;
+} tx_queue; /**< FIFO of one priority class */
+
+/* Normal then bulk */
+static tx_queue _queues[2];
+static uint32_t _baud;
+static uint8_t _class = DGUS_TX_NORMAL;
+static int32_t _tokens;                 /**< bytes the link could take right now, negative while it is behind */
+static uint32_t _last_ms;
+static uint32_t _token_frac;            /**< part of a byte earned but not yet added, in 1/10000 */
+static dgus_millis_cb _millis;
+static uint8_t _sending;                /**< a queued frame is going out, do not queue it again */
+static uint8_t _servicing;
+static uint8_t _failed;
+
+static uint32_t _clock_millis() {
+#ifdef CLOCK_MONOTONIC
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint32_t)((uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+#else
+  // process time, it stands still while the loop sleeps. Set a real clock with dgus_tx_set_clock()
+  return (uint32_t)(clock() / (CLOCKS_PER_SEC / 1000));
+#endif
+}
+
+static uint32_t _now() {
+  return _millis ? _millis() : _clock_millis();
+}
+
+uint32_t dgus_tx_millis() {
+  return _now();
+}
+
+static void _refill() {
+  uint32_t now = _now();
+  uint32_t elapsed = now - _last_ms;
+
+  // a long idle only ever fills the bucket
+  if (elapsed > 1000)
+    elapsed = 1000;
+
+  // 10 bits per byte, milliseconds. Keep the remainder so short intervals are not lost
+  uint64_t earned = (uint64_t)elapsed * _baud + _token_frac;
+  _tokens += earned / 10000;
+  _token_frac = earned % 10000;
+  if (_tokens > TX_BUCKET_BYTES) {
+    _tokens = TX_BUCKET_BYTES;
+    _token_frac = 0;
+  }
+  _last_ms = now;
+}
+
+void dgus_tx_set_baud(uint32_t baud) {
+  _baud = baud;
+  _tokens = TX_BUCKET_BYTES;
+  _token_frac = 0;
+  _last_ms = _now();
+}
+
+uint32_t dgus_tx_get_baud() {
+  return _baud;
+}
+
+void dgus_tx_set_clock(dgus_millis_cb millis) {
+  _millis = millis;
+  _last_ms = _now();
+}
+
+uint8_t dgus_tx_set_class(uint8_t cls) {
+  uint8_t prev = _class;
+  _class = cls;
+  return prev;
+}
+
+uint8_t dgus_tx_pending(uint8_t cls) {
+  if (cls == DGUS_TX_NORMAL)
+    return _queues[0].count;
+  if (cls == DGUS_TX_BULK)
+    return _queues[1].count;
+  return 0;
+}
+
+void dgus_tx_account(uint16_t bytes) {
+  if (_baud)
+    _tokens -= bytes;
+}
+
+static void _send_next(tx_queue *q) {
+  tx_frame *f = &q->frames[q->head];
+
+  q->head = (q->head + 1) % TX_QUEUE_FRAMES;
+  q->count--;
+
+  _sending = 1;
+  if (dgus_send_frame(f->cmd, f->data, f->len) != DGUS_OK)
+    _failed = 1;
+  _sending = 0;
+}
+
+static uint8_t _overlaps(const tx_frame *f, uint16_t vp, uint16_t words) {
+  uint16_t fvp = ((uint16_t)f->data[0] << 8) | f->data[1];
+  uint16_t fwords = (f->len - 1) / 2;
+
+  return fvp < vp + words && vp < fvp + fwords;
+}
+
+/* A write about to jump the queue must not be overwritten by an older queued one */
+static void _flush_overlap(const uint8_t *data, uint8_t len) {
+  uint16_t vp = ((uint16_t)data[0] << 8) | data[1];
+  uint16_t words = (len - 1) / 2;
+
+  for (int c = 0; c < 2; c++) {
+    tx_queue *q = &_queues[c];
+    int last = -1;
+
+    for (int i = 0; i < q->count; i++) {
+      if (_overlaps(&q->frames[(q->head + i) % TX_QUEUE_FRAMES], vp, words))
+        last = i;
+    }
+    for (; last >= 0; last--)
+      _send_next(q);
+  }
+}
+
+uint8_t dgus_tx_enqueue(uint8_t cmd, const uint8_t *data, uint8_t len) {
+  if (!_baud || _sending || cmd != DGUS_CMD_VAR_W || len < 3)
+    return 0;
+
+  _refill();
+
+  tx_queue *q = &_queues[_class == DGUS_TX_BULK ? 1 : 0];
+  uint8_t now = _class == DGUS_TX_INTERACTIVE ||
+                (_class == DGUS_TX_NORMAL && q->count == 0 && _tokens >= len + TX_FRAME_OVERHEAD);
+
+  if (now) {
+    _flush_overlap(data, len);
+    return 0;
+  }
+
+  // queue full, make room at the caller's expense
+  if (q->count >= TX_QUEUE_FRAMES)
+    _send_next(q);
+
+  tx_frame *f = &q->frames[(q->head + q->count) % TX_QUEUE_FRAMES];
+  f->cmd = cmd;
+  f->len = len;
+  memcpy(f->data, data, len);
+  q->count++;
+
+  return 1;
+}
+
+uint8_t dgus_tx_service() {
+  uint8_t n = 0;
+
+  if (!_baud || _servicing)
+    return 0;
+
+  _servicing = 1;
+  while (1) {
+    tx_queue *q = _queues[0].count ? &_queues[0] : &_queues[1];
+    if (q->count == 0)
+      break;
+
+    _refill();
+    int32_t need = q->frames[q->head].len + TX_FRAME_OVERHEAD;
+    if (q == &_queues[1])
+      need += TX_INTERACTIVE_RESERVE;
+    if (_tokens < need)
+      break;
+
+    _send_next(q);
+    n++;
+
+    // let a touch in between frames
+    dgus_recv_data();
+  }
+  _servicing = 0;
+
+  return n;
+}
+
+DGUS_RETURN dgus_tx_flush() {
+  DGUS_RETURN r;
+
+  while (_queues[0].count || _queues[1].count) {
+    if (_servicing) {
+      // called from a handler inside dgus_tx_service(), pacing is not ours to wait on
+      _send_next(_queues[0].count ? &_queues[0] : &_queues[1]);
+    }
+    else {
+      dgus_tx_service();
+    }
+  }
+
+  r = _failed ? DGUS_TIMEOUT : DGUS_OK;
+  _failed = 0;
+  return r;
+}
@@ -0,0 +1,109 @@
+#pragma once
+/**
+ * @file dgus_tx.h
+ * @author Barry Carter
+ * @date 01 Jan 2021
+ * @brief DGUS II LCD Outbound traffic scheduler
+ */
+#include <stddef.h>
+#include <stdint.h>
+#include "dgus_reg.h"
+#include "dgus.h"
+
+/**
+ * @brief Priority of writes made through send_data()
+ */
+enum dgus_tx_class {
+  DGUS_TX_INTERACTIVE,         /**< sent at once, e.g. touch feedback */
+  DGUS_TX_NORMAL,              /**< sent at once while the link has room, else queued ahead of bulk */
+  DGUS_TX_BULK                 /**< always queued, paced to leave room for interactive writes */
+};
+
+/**
+ * @brief Millisecond clock used for pacing. On Arduino like platforms this would be millis()
+ */
+typedef uint32_t (*dgus_millis_cb)(void);
+
+/**
+ * @brief Enable the scheduler for a link running at @p baud
+ * The link carries baud / 10 bytes a second. Bulk writes are only sent while
+ * TX_INTERACTIVE_RESERVE bytes of that budget remain, so an interactive write never waits
+ * behind more than one bulk frame.
+ *
+ * @param baud serial baud rate, 0 disables the scheduler and every write is sent at once
+ */
+void dgus_tx_set_baud(uint32_t baud);
+
+/**
+ * @brief Rate the scheduler paces for
+ *
+ * @return uint32_t baud, 0 while the scheduler is disabled
+ */
+uint32_t dgus_tx_get_baud();
+
+/**
+ * @brief Replace the clock used for pacing
+ * Defaults to CLOCK_MONOTONIC where the platform has it. Elsewhere set one, clock() is only a fallback
+ *
+ * @param millis millisecond clock, NULL for the default
+ */
+void dgus_tx_set_clock(dgus_millis_cb millis);
+
+/**
+ * @brief Current time from the clock set by dgus_tx_set_clock()
+ *
+ * @return uint32_t milliseconds
+ */
+uint32_t dgus_tx_millis();
+
+/**
+ * @brief Set the priority of the writes that follow
+ * Only VAR writes are scheduled. Reads and register writes are always sent at once.
+ *
+ * @param cls #dgus_tx_class
+ * @return uint8_t the previous class, to restore it afterwards
+ */
+uint8_t dgus_tx_set_class(uint8_t cls);
+
+/**
+ * @brief Send queued writes as far as the link budget allows
+ * Incoming packets are processed between frames so touch feedback can go out in between.
+ * Call this in your main loop.
+ *
+ * @return uint8_t frames sent
+ */
+uint8_t dgus_tx_service();
+
+/**
+ * @brief Send every queued write, waiting for the link budget as needed
+ * Use before reading back a VP that may still have a write queued.
+ *
+ * @return #DGUS_RETURN #DGUS_TIMEOUT if any queued write was not acknowledged since the last flush
+ */
+DGUS_RETURN dgus_tx_flush();
+
+/**
+ * @brief Number of writes waiting in a class
+ *
+ * @param cls #dgus_tx_class
+ * @return uint8_t queued frames
+ */
+uint8_t dgus_tx_pending(uint8_t cls);
+
+/* internal */
+/**
+ * @brief Offer a frame to the scheduler. Called from send_data()
+ *
+ * @param cmd frame command
+ * @param data frame payload, VP address first
+ * @param len payload length in bytes
+ * @return uint8_t 1 if the frame was queued and must not be sent
+ */
+uint8_t dgus_tx_enqueue(uint8_t cmd, const uint8_t *data, uint8_t len);
+
+/**
+ * @brief Charge a frame that went out against the link budget
+ *
+ * @param bytes bytes put on the wire
+ */
+void dgus_tx_account(uint16_t bytes);
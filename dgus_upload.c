@@ -0,0 +1,191 @@
+/**
+ * @file dgus_upload.c
+ * @author Barry Carter
+ * @date 01 Jan 2021
+ * @brief DGUS II LCD Asset and OS upload over serial
+ */
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "dgus.h"
+#include "dgus_upload.h"
+
+#define UPLOAD_FRAME_BYTES ((SEND_BUFFER_SIZE - 2) & ~1)  /**< data bytes per write frame */
+
+typedef struct upload_target_t {
+  uint16_t reg;                 /**< register that programs a block */
+  uint32_t block_bytes;
+  uint16_t blocks_per_id;       /**< blocks in one file slot */
+} upload_target; /**< How a target is programmed */
+
+static const upload_target _targets[DGUS_UPLOAD_TARGET_COUNT] = {
+  [DGUS_UPLOAD_ASSET] = { NANDFlashRWCmd, 32768, 8 },
+  [DGUS_UPLOAD_OS]    = { OsUpdateCmd, 4096, 0 },
+};
+
+/* Staging windows, used in turn */
+static const uint16_t _windows[2] = { UPLOAD_WINDOW_A, UPLOAD_WINDOW_B };
+
+uint16_t dgus_crc16(uint16_t crc, const uint8_t *data, size_t len) {
+  while (len--) {
+    crc ^= *data++;
+    for (int i = 0; i < 8; i++)
+      crc = (crc & 1) ? (crc >> 1) ^ 0xA001 : crc >> 1;
+  }
+  return crc;
+}
+
+uint8_t dgus_upload_begin(dgus_upload_state *state, uint8_t target, uint16_t file_id, uint32_t size, uint32_t stamp) {
+  if (state->magic == UPLOAD_STATE_MAGIC && state->target == target && state->file_id == file_id &&
+      state->size == size && state->stamp == stamp)
+    return 1;
+
+  memset(state, 0, sizeof(dgus_upload_state));
+  state->magic = UPLOAD_STATE_MAGIC;
+  state->target = target;
+  state->file_id = file_id;
+  state->size = size;
+  state->stamp = stamp;
+  return 0;
+}
+
+/* The first byte of a command register is cleared by the panel once it is done */
+static DGUS_RETURN _upload_wait(uint16_t reg) {
+  for (int i = 0; i < FLASH_POLL_LIMIT; i++) {
+    uint16_t w = 0;
+    DGUS_RETURN r = dgus_get_var(reg, &w, 1);
+    if (r != DGUS_OK)
+      return r;
+    if ((w >> 8) == 0)
+      return DGUS_OK;
+  }
+  return DGUS_FLASH_BUSY;
+}
+
+/* Send a block into a window, @p len bytes of file then 0xFF up to @p block.
+ * Returns the CRC of what was sent */
+static DGUS_RETURN _upload_stage(uint16_t vp, uint32_t offset, uint32_t len, uint32_t block, dgus_upload_read_cb read, void *ctx, uint16_t *crc) {
+  uint8_t frame[2 + UPLOAD_FRAME_BYTES];
+
+  *crc = 0xFFFF;
+  for (uint32_t sent = 0; sent < block; ) {
+    uint32_t n = block - sent > UPLOAD_FRAME_BYTES ? UPLOAD_FRAME_BYTES : block - sent;
+    uint32_t data = sent >= len ? 0 : len - sent > n ? n : len - sent;
+
+    if (data && read(offset + sent, &frame[2], data, ctx) != data)
+      return DGUS_ERROR;
+    // the rest of the last block is erased flash, not what the window held before
+    memset(&frame[2 + data], 0xFF, n - data);
+    // VP memory is words
+    if (n & 1)
+      frame[2 + n++] = 0xFF;
+
+    frame[0] = vp >> 8;
+    frame[1] = vp & 0xFF;
+    *crc = dgus_crc16(*crc, &frame[2], n);
+    if (dgus_send_frame(DGUS_CMD_VAR_W, frame, 2 + n) != DGUS_OK)
+      return DGUS_TIMEOUT;
+
+    vp += n / 2;
+    sent += n;
+  }
+  return DGUS_OK;
+}
+
+/* Have the panel CRC a window. D7 start, D6 0, D5:D4 VP, D3:D2 words, D1:D0 result */
+static DGUS_RETURN _upload_verify(uint16_t vp, uint16_t words, uint16_t crc) {
+  uint8_t d[10] = {
+    CrcMemoryCheck >> 8, CrcMemoryCheck & 0xFF,
+    UPLOAD_CMD_START, 0x00, vp >> 8, vp & 0xFF, words >> 8, words & 0xFF, 0x00, 0x00
+  };
+  uint16_t res[4];
+
+  DGUS_RETURN r = dgus_send_frame(DGUS_CMD_VAR_W, d, sizeof(d));
+  if (r != DGUS_OK)
+    return r;
+  if ((r = _upload_wait(CrcMemoryCheck)) != DGUS_OK)
+    return r;
+  if ((r = dgus_get_var(CrcMemoryCheck, res, 4)) != DGUS_OK)
+    return r;
+
+  return res[3] == crc ? DGUS_OK : DGUS_UPLOAD_VERIFY;
+}
+
+/* Start programming a block from a window */
+static DGUS_RETURN _upload_program(const upload_target *t, uint32_t block, uint16_t vp) {
+  if (t->reg == OsUpdateCmd) {
+    // D3 start, D2 block, D1:D0 VP
+    uint8_t d[6] = { OsUpdateCmd >> 8, OsUpdateCmd & 0xFF, UPLOAD_CMD_START, block & 0xFF, vp >> 8, vp & 0xFF };
+    return dgus_send_frame(DGUS_CMD_VAR_W, d, sizeof(d));
+  }
+
+  // D7 start, D6 write, D5:D4 block, D3:D2 VP, D1:D0 0
+  uint8_t d[10] = {
+    t->reg >> 8, t->reg & 0xFF,
+    UPLOAD_CMD_START, UPLOAD_CMD_WRITE, block >> 8, block & 0xFF, vp >> 8, vp & 0xFF, 0x00, 0x00
+  };
+  return dgus_send_frame(DGUS_CMD_VAR_W, d, sizeof(d));
+}
+
+DGUS_RETURN dgus_upload_run(dgus_upload_state *state, dgus_upload_read_cb read, dgus_upload_progress_cb progress, void *ctx) {
+  if (state->magic != UPLOAD_STATE_MAGIC || state->target >= DGUS_UPLOAD_TARGET_COUNT)
+    return DGUS_ERROR;
+
+  const upload_target *t = &_targets[state->target];
+  uint32_t blocks = (state->size + t->block_bytes - 1) / t->block_bytes;
+  uint32_t base = state->file_id * t->blocks_per_id;
+  uint8_t busy = 0;
+  DGUS_RETURN r;
+
+  if (t->block_bytes / 2 > UPLOAD_WINDOW_B - UPLOAD_WINDOW_A)
+    return DGUS_ERROR;
+
+  for (uint32_t b = state->next_block; b < blocks; b++) {
+    uint16_t vp = _windows[b & 1];
+    uint32_t offset = b * t->block_bytes;
+    uint32_t len = state->size - offset > t->block_bytes ? t->block_bytes : state->size - offset;
+    uint16_t crc;
+    int tries = 0;
+
+    // stage this block while the panel programs the previous one
+    r = _upload_stage(vp, offset, len, t->block_bytes, read, ctx, &crc);
+
+    if (busy) {
+      DGUS_RETURN w = _upload_wait(t->reg);
+      if (w != DGUS_OK)
+        return w;
+      busy = 0;
+      state->next_block = b;
+      if (progress)
+        progress(state, ctx);
+    }
+
+    while (1) {
+      if (r == DGUS_OK)
+        r = _upload_verify(vp, (t->block_bytes + 1) / 2, crc);
+      if (r == DGUS_OK)
+        break;
+      if (r != DGUS_UPLOAD_VERIFY && r != DGUS_TIMEOUT)
+        return r;
+      if (++tries >= UPLOAD_RETRIES)
+        return r;
+      r = _upload_stage(vp, offset, len, t->block_bytes, read, ctx, &crc);
+    }
+
+    if ((r = _upload_program(t, base + b, vp)) != DGUS_OK)
+      return r;
+    busy = 1;
+  }
+
+  if (busy) {
+    if ((r = _upload_wait(t->reg)) != DGUS_OK)
+      return r;
+    state->next_block = blocks;
+    if (progress)
+      progress(state, ctx);
+  }
+
+  return DGUS_OK;
+}
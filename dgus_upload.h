@@ -0,0 +1,91 @@
+#pragma once
+/**
+ * @file dgus_upload.h
+ * @author Barry Carter
+ * @date 01 Jan 2021
+ * @brief DGUS II LCD Asset and OS upload over serial
+ */
+#include <stddef.h>
+#include <stdint.h>
+#include "dgus_reg.h"
+#include "dgus.h"
+
+#define UPLOAD_STATE_MAGIC  0x55504C44  /**< "UPLD", marks a valid #dgus_upload_state */
+#define UPLOAD_CMD_START    0x5A        /**< First byte of a program or CRC command, cleared when done */
+#define UPLOAD_CMD_WRITE    0x02        /**< NANDFlashRWCmd D6 for a block write */
+
+/**
+ * @brief What is being replaced
+ */
+enum dgus_upload_target {
+  DGUS_UPLOAD_ASSET,           /**< a DWIN_SET file (bitmaps, fonts, configuration) in 32KB blocks via NANDFlashRWCmd */
+  DGUS_UPLOAD_OS,              /**< the panel's OS code in 4KB blocks via OsUpdateCmd */
+  DGUS_UPLOAD_TARGET_COUNT
+};
+
+/**
+ * @brief Progress of one upload. Persist it from the progress callback to resume after a
+ * power cut or a lost link
+ */
+typedef struct dgus_upload_state {
+  uint32_t magic;               /**< UPLOAD_STATE_MAGIC once begun */
+  uint8_t target;               /**< #dgus_upload_target */
+  uint16_t file_id;             /**< DWIN_SET file number, e.g. 32 for 32_*.icl */
+  uint32_t size;                /**< file size in bytes */
+  uint32_t stamp;               /**< caller's identity for the file content, e.g. its CRC or mtime */
+  uint32_t next_block;          /**< first block not yet programmed */
+} dgus_upload_state;
+
+/**
+ * @brief Read file bytes for the upload
+ *
+ * @param offset byte offset in the file
+ * @param buf buffer to fill
+ * @param len bytes wanted
+ * @param ctx context given to dgus_upload_run()
+ * @return uint32_t bytes read, less than @p len only on error
+ */
+typedef uint32_t (*dgus_upload_read_cb)(uint32_t offset, uint8_t *buf, uint32_t len, void *ctx);
+
+/**
+ * @brief Called after each block is programmed, with the state to save
+ */
+typedef void (*dgus_upload_progress_cb)(const dgus_upload_state *state, void *ctx);
+
+/**
+ * @brief Start an upload, or pick up an interrupted one
+ * If @p state already describes the same target, file, size and stamp it is left alone
+ * and dgus_upload_run() carries on from the first block not yet programmed.
+ *
+ * @param state upload state, loaded by the caller from wherever it was saved, or zeroed
+ * @param target #dgus_upload_target
+ * @param file_id DWIN_SET file number
+ * @param size file size in bytes
+ * @param stamp identity of the file content
+ * @return uint8_t 1 if resuming
+ */
+uint8_t dgus_upload_begin(dgus_upload_state *state, uint8_t target, uint16_t file_id, uint32_t size, uint32_t stamp);
+
+/**
+ * @brief Upload the remaining blocks
+ * Each block is staged into one of two VAR windows while the panel programs the other.
+ * Before a block is programmed the panel checks its window with CrcMemoryCheck against the
+ * CRC the host computed while sending, so nothing is read back. A mismatch resends the block.
+ *
+ * @param state state from dgus_upload_begin()
+ * @param read callback reading the file
+ * @param progress called once each block is programmed, may be NULL
+ * @param ctx passed to @p read and @p progress
+ * @return #DGUS_RETURN #DGUS_UPLOAD_VERIFY after UPLOAD_RETRIES bad CRCs, #DGUS_FLASH_BUSY, #DGUS_TIMEOUT
+ */
+DGUS_RETURN dgus_upload_run(dgus_upload_state *state, dgus_upload_read_cb read, dgus_upload_progress_cb progress, void *ctx);
+
+/**
+ * @brief CRC-16/MODBUS as used by the panel
+ *
+ * @param crc running value, 0xFFFF to start
+ * @param data bytes
+ * @param len number of bytes
+ * @return uint16_t updated CRC
+ */
+uint16_t dgus_crc16(uint16_t crc, const uint8_t *data, size_t len);
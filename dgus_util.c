@@ -12,9 +12,14 @@
 #include <time.h> 
 #include "dgus.h"
 #include "dgus_util.h"
+#include "dgus_page.h"
+#include "dgus_tx.h"
 
-/* Change the page on the DGUS */
+/* Change the page on the DGUS, populating it first from deferred writes and its profile */
 DGUS_RETURN dgus_set_page(uint8_t page) {
+  dgus_page_set_current(page);
+  dgus_page_flush(page);
+  dgus_page_preload(page);
   return dgus_set_var(PicSetPage, PIC_SET_PAGE_BASE + page);
 }
 
@@ -22,6 +27,8 @@ DGUS_RETURN dgus_get_page(uint16_t *page) {
   uint16_t pg = 0;
   DGUS_RETURN r = dgus_get_var(PicPage, &pg, 1);
   *page = pg;
+  if (r == DGUS_OK)
+    dgus_page_set_current(pg);
   return r;
 }
 
@@ -100,3 +107,77 @@ DGUS_RETURN dgus_system_reset(uint8_t full_reset) {
 
   return dgus_set_var8(SystemReset, (uint8_t *)&r, sizeof(r));
 }
+
+/* Ask the panel for a new UART2 rate. The ACK may come back at either rate, so it is not
+ * waited for. Give it time to leave the wire, then drop whatever arrived */
+static void _baud_panel(uint16_t div) {
+  uint8_t d[6] = { Uart2Baud >> 8, Uart2Baud & 0xFF, DGUS_BAUD_ENABLE, 0x00, div >> 8, div & 0xFF };
+  uint32_t start;
+
+  dgus_send_frame_nowait(DGUS_CMD_VAR_W, d, sizeof(d));
+  start = dgus_tx_millis();
+  while (dgus_tx_millis() - start < BAUD_SETTLE_MS)
+    ;
+  dgus_recv_reset();
+}
+
+/* Round trips at the current rate. Line noise rarely reads back the same version twice */
+static DGUS_RETURN _baud_probe() {
+  uint16_t first = 0;
+
+  for (int i = 0; i < BAUD_PROBES; i++) {
+    uint16_t ver = 0;
+    if (dgus_get_var(Ver, &ver, 1) != DGUS_OK)
+      return DGUS_TIMEOUT;
+    if (i > 0 && ver != first)
+      return DGUS_ERROR;
+    first = ver;
+  }
+  return DGUS_OK;
+}
+
+static uint16_t _baud_divisor(uint32_t baud) {
+  uint32_t div = (DGUS_BAUD_CLOCK + baud / 2) / baud;
+
+  if (div == 0 || div > 0xFFFF)
+    return 0;
+
+  // the UART copes with about 2% between the ends
+  uint32_t actual = DGUS_BAUD_CLOCK / div;
+  uint32_t diff = actual > baud ? actual - baud : baud - actual;
+  if (diff * 50 > baud)
+    return 0;
+
+  return div;
+}
+
+DGUS_RETURN dgus_set_baud(uint32_t baud) {
+  uint32_t old = dgus_get_host_baud();
+  uint16_t div = baud ? _baud_divisor(baud) : 0;
+  uint16_t old_div = old ? _baud_divisor(old) : 0;
+
+  if (!div || !old_div)
+    return DGUS_BAUD_UNSUPPORTED;
+
+  // make sure the host can take the rate before the panel is committed to it
+  if (dgus_set_host_baud(baud) != DGUS_OK || dgus_set_host_baud(old) != DGUS_OK)
+    return DGUS_ERROR;
+
+  // anything queued was meant for the old rate
+  dgus_tx_flush();
+
+  _baud_panel(div);
+  dgus_set_host_baud(baud);
+
+  if (_baud_probe() == DGUS_OK) {
+    if (dgus_tx_get_baud())
+      dgus_tx_set_baud(baud);
+    return DGUS_OK;
+  }
+
+  // the panel may or may not have switched. Tell it the old rate at the new one, then go back
+  _baud_panel(old_div);
+  dgus_set_host_baud(old);
+
+  return _baud_probe() == DGUS_OK ? DGUS_BAUD_FALLBACK : DGUS_TIMEOUT;
+}
@@ -62,6 +62,7 @@ DGUS_RETURN dgus_get_page(uint16_t *page);
 
 /**
  * @brief Change DGUS page
+ * Deferred writes for the page and values registered with dgus_page_profile_add() are pushed before the flip.
  * 
  * @param page page id
  * @return #DGUS_RETURN 
@@ -117,6 +118,19 @@ DGUS_RETURN dgus_set_volume(uint8_t volume);
  */
 DGUS_RETURN dgus_system_reset(uint8_t full_reset);
 
+/**
+ * @brief Move the panel and the host to a new serial rate
+ * The panel is switched first, without waiting for an ACK that may come at either rate, then
+ * the host through the handler from dgus_set_baud_handler().
+ * The link is checked by reading the version register BAUD_PROBES times. If that fails both
+ * ends are put back on the old rate. The panel returns to its configured rate after a reset.
+ * 
+ * @param baud new rate. The panel rate is 3225600 / n, e.g. 230400, 460800, 806400
+ * @return #DGUS_RETURN #DGUS_BAUD_UNSUPPORTED, #DGUS_BAUD_FALLBACK once back on the old rate,
+ * #DGUS_TIMEOUT if the old rate did not come back either
+ */
+DGUS_RETURN dgus_set_baud(uint32_t baud);
+
 /**
  * @brief Read the system configuration variable
  * 
@@ -0,0 +1,151 @@
+/**
+ * @file dgus_watch.c
+ * @author Barry Carter
+ * @date 01 Jan 2021
+ * @brief DGUS II LCD Watch list polling of VPs that cannot auto-upload
+ */
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "dgus.h"
+#include "dgus_watch.h"
+#include "dgus_tx.h"
+
+#define WATCH_READ_WORDS ((RECV_BUFFER_SIZE - 3) / 2)   /**< words that fit one read reply */
+
+typedef struct watch_entry_t {
+  uint16_t vp;
+  uint8_t words;
+  uint8_t known;                /**< values holds a read */
+  uint16_t fresh_ms;
+  uint32_t interval;            /**< current poll interval, backs off while unchanged */
+  uint32_t due;                 /**< next poll time */
+  dgus_var_handler_cb on_change;
+  void *ctx;
+  uint16_t values[WATCH_ENTRY_WORDS];
+} watch_entry; /**< One watched VP range */
+
+/* Kept sorted by vp so neighbours can share a read */
+static watch_entry _watches[WATCH_MAX_ENTRIES];
+static uint8_t _watch_count;
+
+DGUS_RETURN dgus_watch_add(uint16_t vp, uint8_t words, uint16_t fresh_ms, dgus_var_handler_cb on_change, void *ctx) {
+  uint8_t i = 0;
+
+  if (words == 0 || words > WATCH_ENTRY_WORDS || words > WATCH_READ_WORDS)
+    return DGUS_ERROR;
+  if (_watch_count >= WATCH_MAX_ENTRIES)
+    return DGUS_WATCH_TABLE_FULL;
+
+  while (i < _watch_count && _watches[i].vp < vp)
+    i++;
+
+  // ranges must not overlap
+  if (i > 0 && _watches[i - 1].vp + _watches[i - 1].words > vp)
+    return DGUS_ERROR;
+  if (i < _watch_count && vp + words > _watches[i].vp)
+    return DGUS_ERROR;
+
+  memmove(&_watches[i + 1], &_watches[i], sizeof(watch_entry) * (_watch_count - i));
+  memset(&_watches[i], 0, sizeof(watch_entry));
+  _watches[i].vp = vp;
+  _watches[i].words = words;
+  _watches[i].fresh_ms = fresh_ms;
+  _watches[i].interval = fresh_ms;
+  _watches[i].due = dgus_tx_millis();
+  _watches[i].on_change = on_change;
+  _watches[i].ctx = ctx;
+  _watch_count++;
+
+  return DGUS_OK;
+}
+
+void dgus_watch_remove(uint16_t vp) {
+  for (uint8_t i = 0; i < _watch_count; i++) {
+    if (_watches[i].vp == vp) {
+      memmove(&_watches[i], &_watches[i + 1], sizeof(watch_entry) * (_watch_count - i - 1));
+      _watch_count--;
+      return;
+    }
+  }
+}
+
+static int _due(watch_entry *w, uint32_t now) {
+  return (int32_t)(now - w->due) >= 0;
+}
+
+/* Stretch the interval towards WATCH_BACKOFF_MAX times the freshness */
+static void _backoff(watch_entry *w) {
+  if (w->interval < (uint32_t)w->fresh_ms * WATCH_BACKOFF_MAX) {
+    w->interval += w->interval / 2 + 1;
+    if (w->interval > (uint32_t)w->fresh_ms * WATCH_BACKOFF_MAX)
+      w->interval = (uint32_t)w->fresh_ms * WATCH_BACKOFF_MAX;
+  }
+}
+
+/* Store a fresh read, report a change and adapt the interval */
+static void _update(watch_entry *w, const uint16_t *values, uint32_t now) {
+  uint8_t changed = !w->known || memcmp(w->values, values, w->words * sizeof(uint16_t)) != 0;
+
+  if (changed) {
+    memcpy(w->values, values, w->words * sizeof(uint16_t));
+    w->known = 1;
+    w->interval = w->fresh_ms;
+  }
+  else {
+    _backoff(w);
+  }
+  w->due = now + w->interval;
+
+  if (changed && w->on_change)
+    w->on_change(w->vp, w->values, w->words, w->ctx);
+}
+
+uint8_t dgus_watch_service() {
+  uint32_t now = dgus_tx_millis();
+  uint16_t buf[WATCH_READ_WORDS];
+  uint8_t reads = 0;
+
+  for (uint8_t i = 0; i < _watch_count;) {
+    if (!_due(&_watches[i], now)) {
+      i++;
+      continue;
+    }
+
+    // extend over neighbours while the gap is small and the read still fits one reply
+    uint16_t first = _watches[i].vp;
+    uint8_t last = i;
+    for (uint8_t j = i + 1; j < _watch_count; j++) {
+      watch_entry *w = &_watches[j];
+      if (w->vp - (_watches[j - 1].vp + _watches[j - 1].words) > WATCH_MERGE_GAP)
+        break;
+      if (w->vp + w->words - first > WATCH_READ_WORDS)
+        break;
+      // only worth it if something due comes at or after it
+      if (_due(w, now))
+        last = j;
+    }
+
+    uint8_t words = _watches[last].vp + _watches[last].words - first;
+    if (dgus_get_var(first, buf, words) != DGUS_OK) {
+      // a VP that does not answer must not cost a timeout on every call
+      for (uint8_t j = i; j <= last; j++) {
+        if (_due(&_watches[j], now)) {
+          _backoff(&_watches[j]);
+          _watches[j].due = now + _watches[j].interval;
+        }
+      }
+      i = last + 1;
+      continue;
+    }
+    reads++;
+
+    for (uint8_t j = i; j <= last; j++)
+      _update(&_watches[j], &buf[_watches[j].vp - first], now);
+    i = last + 1;
+  }
+
+  return reads;
+}
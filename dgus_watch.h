@@ -0,0 +1,45 @@
+#pragma once
+/**
+ * @file dgus_watch.h
+ * @author Barry Carter
+ * @date 01 Jan 2021
+ * @brief DGUS II LCD Watch list polling of VPs that cannot auto-upload
+ */
+#include <stddef.h>
+#include <stdint.h>
+#include "dgus_reg.h"
+#include "dgus.h"
+#include "dgus_dispatch.h"
+
+/**
+ * @brief Poll @p words at @p vp and call @p on_change when they change
+ * Use it for values the panel will not upload, e.g. Vcc, Adc01, TpStatus, GuiStatus.
+ * The first read always reports, so the handler starts with the current value.
+ * While a value keeps still its interval backs off up to WATCH_BACKOFF_MAX times
+ * @p fresh_ms, and snaps back to @p fresh_ms when it changes.
+ *
+ * @param vp VP address
+ * @param words number of words, up to WATCH_ENTRY_WORDS
+ * @param fresh_ms poll interval while the value is changing
+ * @param on_change handler, given the new words in host byte order
+ * @param ctx passed to @p on_change
+ * @return DGUS_RETURN #DGUS_WATCH_TABLE_FULL when WATCH_MAX_ENTRIES is reached,
+ * #DGUS_ERROR if the range overlaps a watched one or is too long
+ */
+DGUS_RETURN dgus_watch_add(uint16_t vp, uint8_t words, uint16_t fresh_ms, dgus_var_handler_cb on_change, void *ctx);
+
+/**
+ * @brief Stop watching the VP range starting at @p vp
+ *
+ * @param vp VP address given to dgus_watch_add()
+ */
+void dgus_watch_remove(uint16_t vp);
+
+/**
+ * @brief Poll the watches that are due
+ * Due VPs close together are read in one range read. Watched VPs inside the range that are
+ * not due yet are refreshed with it for free. Call this in your main loop.
+ *
+ * @return uint8_t range reads made
+ */
+uint8_t dgus_watch_service();
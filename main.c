@@ -9,6 +9,8 @@
 #include "dgus.h"
 #include "dgus_control_curve.h"
 #include "dgus_control_text.h"
+#include "dgus_dispatch.h"
+#include "dgus_tx.h"
 
 #define BAUD 115200
 
@@ -89,21 +91,17 @@ void _pg(uint8_t pg) {
         //filecount = 0;
         //files_in_folder = 5;
       };
-      memset(ebuf, 0x20, sizeof(ebuf));
       if (i + (pg * files_in_folder) < folders_count) {
-        snprintf(ebuf, 30, "> %s\\", f);
+        dgus_set_text_format(0x6200 + x, 32, "> %.27s\\", f);
       }
       else {
-        snprintf(ebuf, 30, "%s", f);
+        dgus_set_text_format(0x6200 + x, 32, "%.29s", f);
       }
-      dgus_set_text_padded(0x6200 + x, ebuf, 32);
     //}
     x += 32;
   }
 
-  char buf[10];
-  sprintf(buf, "%-2d/%-2d", pg + 1, (filecount / 7) + 1);
-  dgus_set_text(0x62E0, buf);
+  dgus_set_text_format(0x62E0, 0, "%-2d/%-2d", pg + 1, (filecount / 7) + 1);
 }
 
 
@@ -112,55 +110,63 @@ static struct sp_port *port;
 
 
 
-void _a_recv_handler(char *data, uint8_t cmd, uint8_t len, uint16_t addr, uint8_t bytelen) {
-  printf("JSNDJNASD\n");
-  if (addr == 0x5002 && (uint16_t)*(uint16_t *)data == 1) {
+/* Page up / down / settings keys */
+void _on_nav_key(uint16_t addr, const uint16_t *values, uint8_t words, void *ctx) {
+  if (values[0] == 1) {
     if (_cur_pg > 0)
       _pg(--_cur_pg);
   }
-  else if (addr == 0x5002 && (uint16_t)*(uint16_t *)data == 0x2) {
-    
+  else if (values[0] == 2) {
     if ((_cur_pg + 1 * 7) < filecount)
       _pg(++_cur_pg);
   }
-  else if (addr == 0x5004 && (uint16_t)*(uint16_t *)data >= 0x01 && (uint16_t)*(uint16_t *)data < 0x08) {
-    uint16_t u = (uint16_t)*(uint16_t *)data;
-
-    // ".." clicked
-    if (_sub_depth && u == 1) {
-      _sub_idx = 0;
-      _sub_depth = 0;
-      _pg(0);
-      return;
-    }
-
-    if (u < folders_count) {
-      _sub_idx = u;
-      _pg(0);
-      return;
-    }
-    for (int i = 0; i < 7; i++) {
-      dgus_set_icon(0x610A + i + 1, i + 1 == u);
-    }
-  }
-  else if (addr == 0x5000 && (uint16_t)*(uint16_t *)data == 0x01) {
-    //dgus_set_page(2);
-  }
-  else if (addr == 0x5002 && (uint16_t)*(uint16_t *)data == 0x03) {
+  else if (values[0] == 3) {
     dgus_set_page(4);
   }
-  else if (addr == 0x5006 && (uint16_t)*(uint16_t *)data == 0x03) {
-    dgus_set_page(7);
-  }
-  else if (addr == 0x5008 && (uint16_t)*(uint16_t *)data == 0x01) {
-    dgus_set_page(7);
+}
+
+/* A file row was touched */
+void _on_file_key(uint16_t addr, const uint16_t *values, uint8_t words, void *ctx) {
+  uint16_t u = values[0];
+
+  if (u < 0x01 || u >= 0x08)
+    return;
+
+  // ".." clicked
+  if (_sub_depth && u == 1) {
+    _sub_idx = 0;
+    _sub_depth = 0;
+    _pg(0);
+    return;
   }
-  else if (addr == 0x5008 && (uint16_t)*(uint16_t *)data == 0x02) {
-    dgus_set_page(9);
+
+  if (u < folders_count) {
+    _sub_idx = u;
+    _pg(0);
+    return;
   }
-  else if (addr == 0x5008 && (uint16_t)*(uint16_t *)data == 0x03) {
-    dgus_set_page(8);
+  // selection highlight is touch feedback, it goes ahead of the curve traffic
+  uint8_t cls = dgus_tx_set_class(DGUS_TX_INTERACTIVE);
+  for (int i = 0; i < 7; i++) {
+    dgus_set_icon(0x610A + i + 1, i + 1 == u);
   }
+  dgus_tx_set_class(cls);
+}
+
+/* Keys that only change page. ctx holds the page for values 1, 2 and 3 */
+void _on_page_key(uint16_t addr, const uint16_t *values, uint8_t words, void *ctx) {
+  const uint8_t *pages = ctx;
+
+  if (values[0] >= 1 && values[0] <= 3 && pages[values[0] - 1])
+    dgus_set_page(pages[values[0] - 1]);
+}
+
+void _a_recv_handler(char *data, uint8_t cmd, uint8_t len, uint16_t addr, uint8_t bytelen) {
+  printf("Unhandled packet cmd 0x%02x addr 0x%04x\n", cmd, addr);
+}
+
+uint8_t _serial_set_baud(uint32_t baud) {
+  return sp_set_baudrate(port, baud) == SP_OK ? DGUS_OK : DGUS_ERROR;
 }
 
 uint8_t _serial_bytes_available() {
@@ -189,7 +195,7 @@ int main(int argc, char *argv[])
 // We need a serial port name
   if (argc<2)
     {
-    fprintf(stderr,"Usage port\n");
+    fprintf(stderr,"Usage port [baud]\n");
     exit(1);
     }
 // Open serial port
@@ -207,7 +213,20 @@ int main(int argc, char *argv[])
 // write reset
   cmd=0;
 
-dgus_init(_serial_bytes_available, _serial_recv_byte, _serial_send_data, _a_recv_handler);
+static const uint8_t pages_5006[] = { 0, 0, 7 };
+static const uint8_t pages_5008[] = { 7, 9, 8 };
+
+dgus_init(_serial_bytes_available, _serial_recv_byte, _serial_send_data, dgus_dispatch_packet);
+dgus_dispatch_set_default(_a_recv_handler);
+dgus_tx_set_baud(BAUD);
+dgus_set_baud_handler(_serial_set_baud, BAUD);
+// a faster link only on request, e.g. 460800. Not every panel and adapter can take it
+if (argc > 2 && dgus_set_baud(strtoul(argv[2], NULL, 10)) != DGUS_OK)
+  fprintf(stderr, "Could not switch to %s baud\n", argv[2]);
+dgus_dispatch_register(0x5002, 0x5002, _on_nav_key, NULL);
+dgus_dispatch_register(0x5004, 0x5004, _on_file_key, NULL);
+dgus_dispatch_register(0x5006, 0x5006, _on_page_key, (void *)pages_5006);
+dgus_dispatch_register(0x5008, 0x5008, _on_page_key, (void *)pages_5008);
 
 dgus_set_page(1);
 dgus_set_text_padded(0x6000, "xyz 260.0 000.0 000.0", 32);
@@ -241,12 +260,15 @@ dgus_curve_init_channel(cur, 1);
 int x = 0;
 while(x < 200) {
   dgus_recv_data();
+  dgus_tx_service();
 
   // looping till required time is not achieved 
   if (clock() > start_time + (CLOCKS_PER_SEC/1000) * 500) {
     dgus_curve_add_data(cur, 0, (uint16_t)rand() % 300);
     dgus_curve_add_data(cur, 1, (uint16_t)rand() % 300);
+    uint8_t cls = dgus_tx_set_class(DGUS_TX_BULK);
     dgus_curve_send_data(cur);
+    dgus_tx_set_class(cls);
     printf("CLOCK %ld\n", start_time);
     curve_val = rand() % 1000;
     
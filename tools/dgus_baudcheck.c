@@ -0,0 +1,129 @@
+/**
+ * @file dgus_baudcheck.c
+ * @author Barry Carter
+ * @date 01 Jan 2021
+ * @brief Checks dgus_set_baud() against a fake serial port, no panel needed
+ *
+ * The fake port models a panel on the far end of a UART. Bytes only get through when both
+ * ends run at the same rate, anything else arrives as framing garbage. The panel ACKs a
+ * UART2 rate write at the new rate, like the ambiguous case on real hardware.
+ *
+ * usage: dgus-baudcheck
+ */
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "dgus.h"
+#include "dgus_util.h"
+#include "dgus_tx.h"
+
+#define FAKE_RX_BYTES 512
+#define FAKE_VERSION  0x0123
+
+typedef struct fake_port_t {
+  uint32_t host_baud;
+  uint32_t panel_baud;
+  uint8_t honours_baud;         /* 0 models firmware that ignores UART2 rate writes */
+  uint8_t rx[FAKE_RX_BYTES];    /* panel to host, not yet read */
+  uint16_t rx_len;
+  uint16_t rx_pos;
+} fake_port;
+
+static fake_port _port;
+
+/* Bytes the panel puts on the wire. A rate mismatch turns them into garbage */
+static void _fake_reply(const uint8_t *data, uint8_t len) {
+  for (int i = 0; i < len && _port.rx_len < FAKE_RX_BYTES; i++)
+    _port.rx[_port.rx_len++] = _port.host_baud == _port.panel_baud ? data[i] : 0x00;
+}
+
+static void _fake_ack() {
+  uint8_t ok[] = { HEADER0, HEADER1, 3, DGUS_CMD_VAR_W, 'O', 'K' };
+  _fake_reply(ok, sizeof(ok));
+}
+
+/* The panel end: decode one frame and answer it */
+static void _fake_panel(const uint8_t *f, size_t len) {
+  if (len < 6 || f[0] != HEADER0 || f[1] != HEADER1 || f[2] + 3u != len)
+    return;
+
+  uint8_t cmd = f[3];
+  uint16_t vp = (f[4] << 8) | f[5];
+
+  if (cmd == DGUS_CMD_VAR_W && vp == Uart2Baud && len == 10 && f[6] == DGUS_BAUD_ENABLE) {
+    uint16_t div = (f[8] << 8) | f[9];
+    if (_port.honours_baud && div)
+      _port.panel_baud = DGUS_BAUD_CLOCK / div;
+    _fake_ack();
+  }
+  else if (cmd == DGUS_CMD_VAR_W) {
+    _fake_ack();
+  }
+  else if (cmd == DGUS_CMD_VAR_R && len == 7) {
+    uint8_t words = f[6];
+    uint8_t r[RECV_BUFFER_SIZE] = { HEADER0, HEADER1, 4 + words * 2, DGUS_CMD_VAR_R, f[4], f[5], words };
+    for (int i = 0; i < words && 7 + i * 2 + 1 < (int)sizeof(r); i++) {
+      uint16_t v = vp + i == Ver ? FAKE_VERSION : 0;
+      r[7 + i * 2] = v >> 8;
+      r[8 + i * 2] = v & 0xFF;
+    }
+    _fake_reply(r, 7 + words * 2);
+  }
+}
+
+static uint8_t _fake_avail() {
+  uint16_t n = _port.rx_len - _port.rx_pos;
+  return n > 255 ? 255 : n;
+}
+
+static char _fake_recv() {
+  if (_port.rx_pos == _port.rx_len)
+    return 0;
+  char c = _port.rx[_port.rx_pos++];
+  if (_port.rx_pos == _port.rx_len)
+    _port.rx_pos = _port.rx_len = 0;
+  return c;
+}
+
+static void _fake_send(char *data, size_t len) {
+  // sent at the wrong rate the panel sees garbage and answers nothing
+  if (_port.host_baud == _port.panel_baud)
+    _fake_panel((const uint8_t *)data, len);
+}
+
+static uint8_t _fake_set_baud(uint32_t baud) {
+  _port.host_baud = baud;
+  _port.rx_len = _port.rx_pos = 0;
+  return DGUS_OK;
+}
+
+static int _check(const char *name, uint8_t honours, uint32_t baud, DGUS_RETURN want, uint32_t want_baud) {
+  memset(&_port, 0, sizeof(_port));
+  _port.host_baud = _port.panel_baud = 115200;
+  _port.honours_baud = honours;
+  dgus_set_baud_handler(_fake_set_baud, 115200);
+
+  uint32_t start = dgus_tx_millis();
+  DGUS_RETURN r = dgus_set_baud(baud);
+  uint32_t took = dgus_tx_millis() - start;
+
+  int ok = r == want && _port.host_baud == want_baud && _port.panel_baud == want_baud &&
+           dgus_get_host_baud() == want_baud;
+  printf("%-9s %s: returned %d, host %lu, panel %lu, %lu ms\n", name, ok ? "ok" : "FAILED", r,
+         (unsigned long)_port.host_baud, (unsigned long)_port.panel_baud, (unsigned long)took);
+  return ok;
+}
+
+int main() {
+  int ok = 1;
+
+  dgus_init(_fake_avail, _fake_recv, _fake_send, NULL);
+
+  ok &= _check("switch", 1, 460800, DGUS_OK, 460800);
+  ok &= _check("fallback", 0, 460800, DGUS_BAUD_FALLBACK, 115200);
+  ok &= _check("reject", 1, 3000000, DGUS_BAUD_UNSUPPORTED, 115200);
+
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,435 @@
+/**
+ * @file dgus_capstat.c
+ * @author Barry Carter
+ * @date 01 Jan 2021
+ * @brief Link usage report for a capture written by dgus_capture_flush()
+ *
+ * Frames are decoded with the library parser, then counted per command and per VP.
+ * Also reported: writes that re-send the value the panel already holds, how long the panel
+ * takes to acknowledge a write or answer a read, and the idle gaps on the link.
+ *
+ * usage: dgus-capstat [-b baud] [-g gap_ms] [-n top] capture.dcap
+ */
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <unistd.h>
+#include "dgus.h"
+#include "dgus_capture.h"
+
+#define STAGE_BYTES  512        /* per direction, enough for a split record plus a partial frame */
+#define HIST_BUCKETS 24         /* power of two microsecond buckets, 1us to 8s */
+
+typedef struct stat_t {
+  uint32_t frames;
+  uint64_t bytes;
+} stat;
+
+typedef struct vp_stat_t {
+  stat tx;
+  stat rx;
+  uint32_t redundant;           /* writes that changed nothing */
+  uint64_t redundant_bytes;
+} vp_stat;
+
+typedef struct latency_t {
+  uint32_t count;
+  uint64_t total;
+  uint32_t min;
+  uint32_t max;
+  uint32_t hist[HIST_BUCKETS];
+} latency;
+
+typedef struct stage_t {
+  uint8_t buf[STAGE_BYTES];
+  size_t len;
+  uint64_t discarded;
+} stage;
+
+static stat _cmds[2][256];                /* [rx][cmd] */
+static vp_stat _vps[0x10000];
+static uint16_t _value[0x10000];          /* last value known to be on the panel */
+static uint8_t _known[0x10000 / 8];
+
+static latency _ack;                      /* write to OK */
+static latency _reply;                    /* read request to its answer */
+static latency _gaps;                     /* idle time between records longer than the threshold */
+static uint64_t _gap_total;
+
+static uint8_t _ack_pending;
+static uint64_t _ack_sent;
+static uint8_t _read_pending;
+static uint16_t _read_vp;
+static uint64_t _read_sent;
+static uint32_t _unanswered;
+
+static stage _stage[2];
+static uint64_t _wire[2];
+
+static void _latency_add(latency *l, uint64_t us) {
+  uint32_t v = us > UINT32_MAX ? UINT32_MAX : us;
+  uint8_t b = 0;
+
+  if (l->count == 0 || v < l->min)
+    l->min = v;
+  if (v > l->max)
+    l->max = v;
+  l->count++;
+  l->total += v;
+
+  while (b < HIST_BUCKETS - 1 && (1u << (b + 1)) <= v)
+    b++;
+  l->hist[b]++;
+}
+
+static uint8_t _is_known(uint16_t vp) {
+  return _known[vp / 8] & (1 << (vp % 8));
+}
+
+static void _set_known(uint16_t vp, uint16_t value) {
+  _known[vp / 8] |= 1 << (vp % 8);
+  _value[vp] = value;
+}
+
+/* A VAR write. Redundant when every word it carries is already on the panel */
+static void _var_write(const dgus_frame *f) {
+  uint16_t vp = (f->data[0] << 8) | f->data[1];
+  uint8_t words = (f->len - 2) / 2;
+  uint8_t same = words > 0;
+
+  for (uint8_t i = 0; i < words; i++) {
+    uint16_t a = vp + i;
+    uint16_t v = (f->data[2 + i * 2] << 8) | f->data[3 + i * 2];
+    if (!_is_known(a) || _value[a] != v)
+      same = 0;
+    _set_known(a, v);
+  }
+  // half a word, the other byte is unknown now
+  if (f->len & 1)
+    _known[(uint16_t)(vp + words) / 8] &= ~(1 << ((uint16_t)(vp + words) % 8));
+
+  if (same) {
+    _vps[vp].redundant++;
+    _vps[vp].redundant_bytes += f->len + 4;
+  }
+}
+
+/* A read answer or an auto upload, both tell us what the panel holds */
+static void _var_upload(const dgus_frame *f) {
+  uint16_t vp = (f->data[0] << 8) | f->data[1];
+
+  for (uint8_t i = 0; i < f->data[2]; i++)
+    _set_known(vp + i, (f->data[3 + i * 2] << 8) | f->data[4 + i * 2]);
+}
+
+static void _frame(uint8_t rx, const dgus_frame *f, uint64_t t) {
+  uint16_t bytes = f->len + 4;
+  uint8_t ok = f->cmd == DGUS_CMD_VAR_W || f->cmd == DGUS_CMD_REG_W;
+
+  _cmds[rx][f->cmd].frames++;
+  _cmds[rx][f->cmd].bytes += bytes;
+
+  // an OK carries no address
+  ok = ok && rx;
+  if (!ok && (f->cmd == DGUS_CMD_VAR_W || f->cmd == DGUS_CMD_VAR_R)) {
+    uint16_t vp = (f->data[0] << 8) | f->data[1];
+    stat *s = rx ? &_vps[vp].rx : &_vps[vp].tx;
+    s->frames++;
+    s->bytes += bytes;
+  }
+
+  if (!rx) {
+    if (_ack_pending || _read_pending)
+      _unanswered++;
+    _ack_pending = 0;
+    _read_pending = 0;
+    if (f->cmd == DGUS_CMD_VAR_R) {
+      _read_pending = 1;
+      _read_vp = (f->data[0] << 8) | f->data[1];
+      _read_sent = t;
+    }
+    else {
+      _ack_pending = 1;
+      _ack_sent = t;
+    }
+    if (f->cmd == DGUS_CMD_VAR_W)
+      _var_write(f);
+    return;
+  }
+
+  if (ok) {
+    if (_ack_pending)
+      _latency_add(&_ack, t - _ack_sent);
+    _ack_pending = 0;
+  }
+  else if (f->cmd == DGUS_CMD_VAR_R) {
+    uint16_t vp = (f->data[0] << 8) | f->data[1];
+    if (_read_pending && vp == _read_vp) {
+      _latency_add(&_reply, t - _read_sent);
+      _read_pending = 0;
+    }
+    _var_upload(f);
+  }
+}
+
+/* Add a record's bytes to its direction and take every complete frame */
+static void _record(uint8_t rx, const uint8_t *data, uint16_t len, uint64_t t) {
+  stage *s = &_stage[rx];
+  dgus_frame f;
+  size_t used;
+
+  _wire[rx] += len;
+  if (s->len + len > sizeof(s->buf)) {
+    s->discarded += s->len;
+    s->len = 0;
+  }
+  memcpy(&s->buf[s->len], data, len);
+  s->len += len;
+
+  while (s->len) {
+    uint8_t found = rx ? dgus_frame_scan(s->buf, s->len, &used, &f)
+                       : dgus_frame_scan_sent(s->buf, s->len, &used, &f);
+    if (found) {
+      s->discarded += used - f.len - 4;
+      _frame(rx, &f, t);
+    }
+    else {
+      s->discarded += used;
+    }
+    memmove(s->buf, &s->buf[used], s->len - used);
+    s->len -= used;
+    if (!found)
+      break;
+  }
+}
+
+static uint8_t *_load(const char *path, size_t *len) {
+  FILE *fp = fopen(path, "rb");
+  uint8_t *buf = NULL;
+  size_t cap = 0;
+  size_t n;
+
+  if (!fp)
+    return NULL;
+
+  *len = 0;
+  do {
+    if (*len == cap) {
+      cap = cap ? cap * 2 : 65536;
+      uint8_t *b = realloc(buf, cap);
+      if (!b) {
+        free(buf);
+        fclose(fp);
+        return NULL;
+      }
+      buf = b;
+    }
+    n = fread(&buf[*len], 1, cap - *len, fp);
+    *len += n;
+  } while (n);
+
+  fclose(fp);
+  return buf;
+}
+
+static double _rate(uint64_t bytes, uint64_t us) {
+  return us ? bytes * 1000000.0 / us : 0;
+}
+
+static const char *_cmd_name(uint8_t cmd) {
+  switch (cmd) {
+    case DGUS_CMD_REG_W: return "REG_W";
+    case DGUS_CMD_REG_R: return "REG_R";
+    case DGUS_CMD_VAR_W: return "VAR_W";
+    case DGUS_CMD_VAR_R: return "VAR_R";
+    case DGUS_CMD_CURVE_W: return "CURVE_W";
+  }
+  return "?";
+}
+
+static void _print_latency(const char *name, latency *l) {
+  printf("\n%s: %u", name, l->count);
+  if (l->count == 0) {
+    printf("\n");
+    return;
+  }
+  printf(", min %uus avg %lluus max %uus\n", l->min, (unsigned long long)(l->total / l->count), l->max);
+
+  for (int b = 0; b < HIST_BUCKETS; b++) {
+    if (!l->hist[b])
+      continue;
+    int bar = (int)((uint64_t)l->hist[b] * 40 / l->count);
+    printf("  >= %8uus %8u ", b ? 1u << b : 0, l->hist[b]);
+    for (int i = 0; i < bar; i++)
+      putchar('#');
+    putchar('\n');
+  }
+}
+
+static uint64_t _vp_bytes(const vp_stat *v) {
+  return v->tx.bytes + v->rx.bytes;
+}
+
+static int _vp_cmp(const void *a, const void *b) {
+  uint64_t x = _vp_bytes(&_vps[*(const uint16_t *)a]);
+  uint64_t y = _vp_bytes(&_vps[*(const uint16_t *)b]);
+  return x < y ? 1 : x > y ? -1 : 0;
+}
+
+static int _redundant_cmp(const void *a, const void *b) {
+  uint64_t x = _vps[*(const uint16_t *)a].redundant_bytes;
+  uint64_t y = _vps[*(const uint16_t *)b].redundant_bytes;
+  return x < y ? 1 : x > y ? -1 : 0;
+}
+
+static void _usage(const char *name) {
+  fprintf(stderr, "usage: %s [-b baud] [-g gap_ms] [-n top] capture.dcap\n", name);
+  fprintf(stderr, "  -b  link baud rate for the utilisation figure, default 115200\n");
+  fprintf(stderr, "  -g  shortest silence counted as an idle gap, default 10ms\n");
+  fprintf(stderr, "  -n  VPs listed in each table, default 20\n");
+}
+
+int main(int argc, char *argv[]) {
+  uint32_t baud = 115200;
+  uint32_t gap_us = 10000;
+  int top = 20;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "b:g:n:h")) != -1) {
+    switch (opt) {
+      case 'b': baud = strtoul(optarg, NULL, 0); break;
+      case 'g': gap_us = strtoul(optarg, NULL, 0) * 1000; break;
+      case 'n': top = atoi(optarg); break;
+      default: _usage(argv[0]); return 2;
+    }
+  }
+  if (optind != argc - 1 || baud == 0) {
+    _usage(argv[0]);
+    return 2;
+  }
+
+  size_t len;
+  uint8_t *cap = _load(argv[optind], &len);
+  if (!cap) {
+    perror(argv[optind]);
+    return 1;
+  }
+  if (len < CAPTURE_HEADER_LEN || memcmp(cap, "DCAP", 4) != 0 || cap[4] != CAPTURE_VERSION) {
+    fprintf(stderr, "%s: not a version %d capture\n", argv[optind], CAPTURE_VERSION);
+    free(cap);
+    return 1;
+  }
+
+  uint64_t t = 0;
+  uint64_t records = 0;
+  uint8_t truncated = 0;
+  size_t pos = CAPTURE_HEADER_LEN;
+
+  while (pos < len) {
+    uint8_t tag = cap[pos++];
+    uint64_t delta = 0;
+
+    for (uint8_t shift = 0; pos < len && shift < 63; shift += 7) {
+      uint8_t b = cap[pos++];
+      delta |= (uint64_t)(b & 0x7F) << shift;
+      if (!(b & 0x80))
+        break;
+    }
+
+    uint16_t n = (tag & 0x7F) + 1;
+    if (pos + n > len) {
+      truncated = 1;
+      break;
+    }
+
+    if (records && delta >= gap_us) {
+      _latency_add(&_gaps, delta);
+      _gap_total += delta;
+    }
+    t += delta;
+    records++;
+
+    _record(tag & CAPTURE_TAG_RX ? 1 : 0, &cap[pos], n, t);
+    pos += n;
+  }
+  free(cap);
+
+  /* Totals */
+  uint64_t wire = _wire[0] + _wire[1];
+  printf("capture: %llu records over %.3fs%s\n", (unsigned long long)records, t / 1e6,
+         truncated ? " (last record cut short)" : "");
+  printf("sent %llu bytes (%.0f B/s), received %llu bytes (%.0f B/s)\n",
+         (unsigned long long)_wire[0], _rate(_wire[0], t), (unsigned long long)_wire[1], _rate(_wire[1], t));
+  // 10 bits on the wire per byte, 8N1. Each direction has the full rate
+  if (t)
+    printf("link busy: tx %.1f%% rx %.1f%% at %u baud\n",
+           _wire[0] * 10 * 100.0 * 1000000 / ((double)baud * t),
+           _wire[1] * 10 * 100.0 * 1000000 / ((double)baud * t), baud);
+  printf("bytes outside frames: tx %llu rx %llu\n",
+         (unsigned long long)(_stage[0].discarded + _stage[0].len),
+         (unsigned long long)(_stage[1].discarded + _stage[1].len));
+
+  /* Per command */
+  printf("\n%-4s %-8s %-4s %10s %12s %10s %6s\n", "cmd", "name", "dir", "frames", "bytes", "B/s", "share");
+  for (int rx = 0; rx < 2; rx++) {
+    for (int c = 0; c < 256; c++) {
+      stat *s = &_cmds[rx][c];
+      if (!s->frames)
+        continue;
+      printf("0x%02X %-8s %-4s %10u %12llu %10.0f %5.1f%%\n", c, _cmd_name(c), rx ? "rx" : "tx",
+             s->frames, (unsigned long long)s->bytes, _rate(s->bytes, t), wire ? s->bytes * 100.0 / wire : 0);
+    }
+  }
+
+  /* Per VP */
+  uint16_t *order = malloc(sizeof(uint16_t) * 0x10000);
+  int used = 0;
+  uint32_t redundant = 0;
+  uint64_t redundant_bytes = 0;
+
+  if (!order)
+    return 1;
+  for (uint32_t vp = 0; vp < 0x10000; vp++) {
+    if (_vps[vp].tx.frames || _vps[vp].rx.frames)
+      order[used++] = vp;
+    redundant += _vps[vp].redundant;
+    redundant_bytes += _vps[vp].redundant_bytes;
+  }
+
+  qsort(order, used, sizeof(uint16_t), _vp_cmp);
+  printf("\n%d VPs addressed, busiest first\n", used);
+  printf("%-6s %10s %12s %10s %12s %10s %10s\n", "vp", "tx frames", "tx bytes", "rx frames", "rx bytes", "B/s", "redundant");
+  for (int i = 0; i < used && i < top; i++) {
+    vp_stat *v = &_vps[order[i]];
+    printf("0x%04X %10u %12llu %10u %12llu %10.0f %10u\n", order[i],
+           v->tx.frames, (unsigned long long)v->tx.bytes, v->rx.frames, (unsigned long long)v->rx.bytes,
+           _rate(_vp_bytes(v), t), v->redundant);
+  }
+
+  /* Redundant writes */
+  printf("\nredundant writes: %u frames, %llu bytes (%.1f%% of sent)\n", redundant,
+         (unsigned long long)redundant_bytes, _wire[0] ? redundant_bytes * 100.0 / _wire[0] : 0);
+  if (redundant) {
+    qsort(order, used, sizeof(uint16_t), _redundant_cmp);
+    printf("%-6s %10s %12s %8s\n", "vp", "frames", "bytes", "of vp");
+    for (int i = 0; i < used && i < top && _vps[order[i]].redundant; i++) {
+      vp_stat *v = &_vps[order[i]];
+      printf("0x%04X %10u %12llu %7.1f%%\n", order[i], v->redundant, (unsigned long long)v->redundant_bytes,
+             v->redundant * 100.0 / v->tx.frames);
+    }
+  }
+  free(order);
+
+  /* Latency and gaps */
+  _print_latency("write to OK", &_ack);
+  _print_latency("read to answer", &_reply);
+  if (_unanswered)
+    printf("\n%u frames sent before the previous one was answered\n", _unanswered);
+  _print_latency("idle gaps", &_gaps);
+  if (_gaps.count)
+    printf("idle %.3fs, %.1f%% of the capture\n", _gap_total / 1e6, t ? _gap_total * 100.0 / t : 0);
+
+  return 0;
+}
@@ -0,0 +1,71 @@
+#!/usr/bin/env python3
+"""
+Generate dgus_text_gbk.c, the compact Unicode (BMP) to GBK lookup table used by
+dgus_text_transcode().
+
+Codepoints are split into 256 pages by their high byte. Each populated page
+stores the GBK codes for its low byte range [lo, hi] in one shared array, with
+0 marking unmapped codepoints inside the range.
+
+usage: tools/gen_gbk_table.py > dgus_text_gbk.c
+"""
+
+pages = {}
+for cp in range(0x80, 0x10000):
+    if 0xD800 <= cp < 0xE000:
+        continue
+    try:
+        b = chr(cp).encode('gbk')
+    except UnicodeEncodeError:
+        continue
+    if len(b) != 2:
+        continue
+    pages.setdefault(cp >> 8, {})[cp & 0xFF] = (b[0] << 8) | b[1]
+
+out = []
+out.append('/**')
+out.append(' * @file dgus_text_gbk.c')
+out.append(' * @brief Unicode to GBK lookup table. Generated by tools/gen_gbk_table.py, do not edit')
+out.append(' */')
+out.append('#include <stdint.h>')
+out.append('#include "dgus.h"')
+out.append('')
+out.append('#if TEXT_TRANSCODE_GBK')
+out.append('')
+
+slots = sorted(pages)
+out.append('/* slot of each high byte page in the range tables, 0xFF when the page has no mapping */')
+out.append('const uint8_t dgus_gbk_page_slot[256] = {')
+idx = {p: i for i, p in enumerate(slots)}
+row = []
+for p in range(256):
+    row.append('0x%02X' % idx.get(p, 0xFF))
+    if len(row) == 16:
+        out.append('  ' + ', '.join(row) + ',')
+        row = []
+out.append('};')
+out.append('')
+
+offs, los, his, data = [], [], [], []
+for p in slots:
+    m = pages[p]
+    lo, hi = min(m), max(m)
+    offs.append(len(data))
+    los.append(lo)
+    his.append(hi)
+    data.extend(m.get(i, 0) for i in range(lo, hi + 1))
+
+def emit(name, ctype, vals, fmt, per):
+    out.append('const %s %s[%d] = {' % (ctype, name, len(vals)))
+    for i in range(0, len(vals), per):
+        out.append('  ' + ', '.join(fmt % v for v in vals[i:i + per]) + ',')
+    out.append('};')
+    out.append('')
+
+emit('dgus_gbk_page_lo', 'uint8_t', los, '0x%02X', 16)
+emit('dgus_gbk_page_hi', 'uint8_t', his, '0x%02X', 16)
+emit('dgus_gbk_page_off', 'uint16_t', offs, '0x%04X', 12)
+emit('dgus_gbk_codes', 'uint16_t', data, '0x%04X', 12)
+
+out.append('#endif')
+print('\n'.join(out))